@@ -0,0 +1,83 @@
+// Gallery scan benchmark: times the Classification scan of a random gallery on regular,
+// transparent huge and explicit huge pages, with the data TLB misses of the scans
+// (0 when perf events are not permitted, see perf_event_paranoid).
+//
+//   gallery_scan_benchmark [rows] [dimension] [iterations]
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "classifier.hpp"
+#include "gallery.hpp"
+#include "gallery_replicas.hpp"
+
+namespace {
+
+struct ScanResult {
+    double milliseconds;
+    unsigned long long tlbMisses;
+};
+
+ScanResult scan(const std::shared_ptr<const Gallery> &gallery, HugePages pages, int iterations) {
+    auto replicas = std::make_shared<GalleryReplicas>(gallery, GalleryPlacement::Local, pages);
+    replicas->countTlbMisses(true);
+    Classification classifier(replicas);
+
+    std::mt19937 generator(1);
+    std::normal_distribution<float> distribution;
+    std::vector<float> probe(gallery->dimension());
+    for (auto &value : probe) value = distribution(generator);
+    // The first scan faults the pages in
+    classifier.classify(probe);
+    replicas->resetBandwidth();
+    for (int i = 0; i < iterations; ++i) {
+        classifier.classify(probe);
+    }
+
+    ScanResult result = {0.0, 0};
+    for (auto &node : replicas->bandwidth()) {
+        result.milliseconds += node.milliseconds;
+        result.tlbMisses += node.tlbMisses;
+    }
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    const int rows = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    const int dimension = argc > 2 ? std::atoi(argv[2]) : 512;
+    const int iterations = argc > 3 ? std::atoi(argv[3]) : 20;
+    if (rows <= 0 || dimension <= 0 || iterations <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [rows] [dimension] [iterations]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 generator(0);
+    std::normal_distribution<float> distribution;
+    std::vector<int> rowLabels(rows, 0);
+    std::vector<std::vector<float>> embeddings(rows, std::vector<float>(dimension));
+    for (auto &embedding : embeddings) {
+        for (auto &value : embedding) value = distribution(generator);
+    }
+    std::shared_ptr<const Gallery> gallery = Gallery::build({"benchmark"}, rowLabels, embeddings);
+    embeddings.clear();
+
+    std::cout << rows << " x " << dimension << " gallery, " << iterations << " scans" << std::endl;
+    const struct {
+        const char *name;
+        HugePages pages;
+    } modes[] = {{"4K", HugePages::None}, {"transparent 2M", HugePages::Transparent},
+                 {"explicit 2M", HugePages::Explicit}};
+    for (auto &mode : modes) {
+        const ScanResult result = scan(gallery, mode.pages, iterations);
+        std::cout << std::setw(16) << mode.name << ": " << std::fixed << std::setprecision(2)
+                  << result.milliseconds / iterations << " ms per scan, "
+                  << result.tlbMisses / iterations << " dTLB misses per scan" << std::endl;
+    }
+    return 0;
+}
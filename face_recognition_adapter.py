@@ -1,6 +1,8 @@
 #!/usr/bin/python3
 
 import argparse
+import mmap
+import os
 import numpy as np
 import ctypes as C
 import cv2
@@ -13,6 +15,10 @@ def get_parser():
 
 face_recognition = C.cdll.LoadLibrary('libface_recognition.so')
 
+# Mirrors AlignedFaceRecord in include/face_arena.hpp
+class AlignedFaceRecord(C.Structure):
+    _fields_ = [('offset', C.c_uint64), ('rows', C.c_uint32), ('cols', C.c_uint32)]
+
 def recognize_faces(image):
     (rows, cols, depth) = (image.shape[0], image.shape[1], image.shape[2])
     detection_results = np.zeros(dtype=np.uint8, shape=(rows, cols, depth))
@@ -24,35 +30,20 @@ def recognize_faces(image):
                                     recognition_results.ctypes.data_as(C.POINTER(C.c_ubyte)),
                                     )
 
-    aligned_faces_count = face_recognition.getAlignedFacesCount()
-    align_width = np.zeros(dtype=np.uint32, shape=(1, aligned_faces_count))
-    align_height = np.zeros(dtype=np.uint32, shape=(1, aligned_faces_count))
-
-    face_recognition.getAlignedFacesSizes(align_width.ctypes.data_as(C.POINTER(C.c_uint)),
-                                          align_height.ctypes.data_as(C.POINTER(C.c_uint)))
-
-
-    align_cols = 0
-    align_rows = 0
-
-    for i in range(aligned_faces_count):
-        align_cols += align_width[0][i]
-        align_rows += align_height[0][i]
-
-    align_data = np.zeros(dtype=np.uint8, shape=(1, align_rows * align_cols * depth))
-    face_recognition.getAlignedFaces(align_data.ctypes.data_as(C.POINTER(C.c_ubyte)))
+    data = C.POINTER(C.c_ubyte)()
+    table = C.POINTER(AlignedFaceRecord)()
+    slot_rows, slot_cols = C.c_uint(), C.c_uint()
+    slots = face_recognition.getAlignedFacesArena(C.byref(data), C.byref(table),
+                                                  C.byref(slot_rows), C.byref(slot_cols))
 
     align_results = []
-    for i in range(aligned_faces_count):
-        width = align_width[0][i]
-        height = align_height[0][i]
-        size = width * height * depth
-      
-        face = align_data[:, :size]
-        align_data = align_data[:, size:]
-        
-        align_results.append(face.reshape(height, width, depth))
-    
+    if slots:
+        # One copy of the whole arena; the engine reuses it on the next call
+        arena = np.ctypeslib.as_array(data, shape=(slots, slot_rows.value, slot_cols.value, depth)).copy()
+        for i in range(slots):
+            if table[i].rows:
+                align_results.append(arena[i])
+
     face_recognition.getFaceRecognitionTime.restype = C.c_double
     recognition_time = face_recognition.getFaceRecognitionTime()
     
@@ -60,6 +51,335 @@ def recognize_faces(image):
 
     return detection_results, recognition_results, align_results, recognition_time
 
+face_recognition.createEngine.restype = C.c_void_p
+face_recognition.createEngine.argtypes = [C.c_char_p, C.c_char_p, C.c_char_p, C.c_char_p, C.c_int]
+face_recognition.createEngineWithOptions.restype = C.c_void_p
+face_recognition.createEngineWithOptions.argtypes = [C.c_char_p, C.c_char_p, C.c_char_p, C.c_char_p, C.c_char_p]
+face_recognition.getEngineDetectionStats.argtypes = [C.c_void_p, C.POINTER(C.c_ulonglong), C.POINTER(C.c_ulonglong)]
+face_recognition.getEngineEmbeddingStats.argtypes = [C.c_void_p, C.POINTER(C.c_ulonglong), C.POINTER(C.c_ulonglong),
+                                                     C.POINTER(C.c_ulonglong)]
+face_recognition.destroyEngine.argtypes = [C.c_void_p]
+face_recognition.createSession.restype = C.c_void_p
+face_recognition.createSession.argtypes = [C.c_void_p]
+face_recognition.destroySession.argtypes = [C.c_void_p]
+face_recognition.createShardedEngine.restype = C.c_void_p
+face_recognition.createShardedEngine.argtypes = [C.c_char_p, C.c_char_p, C.c_char_p, C.c_char_p, C.c_int, C.c_char_p,
+                                                 C.c_int, C.c_char_p]
+for bandwidth in (face_recognition.getEngineGalleryBandwidth, face_recognition.getShardedEngineGalleryBandwidth):
+    bandwidth.argtypes = [C.c_void_p, C.POINTER(C.c_ulonglong), C.POINTER(C.c_ulonglong), C.POINTER(C.c_double),
+                          C.POINTER(C.c_ulonglong), C.c_int]
+face_recognition.getAllocationStats.argtypes = [C.c_char_p, C.POINTER(C.c_ulonglong), C.POINTER(C.c_ulonglong),
+                                                C.POINTER(C.c_ulonglong), C.c_int]
+face_recognition.setAllocationBudget.argtypes = [C.c_char_p, C.c_double]
+face_recognition.checkAllocationBudget.argtypes = [C.c_double]
+face_recognition.verifyAllocations.argtypes = [C.c_void_p, C.POINTER(C.c_ubyte), C.c_int, C.c_int,
+                                               C.c_int, C.c_int, C.c_double]
+face_recognition.destroyShardedEngine.argtypes = [C.c_void_p]
+face_recognition.createStreamSession.restype = C.c_void_p
+face_recognition.createStreamSession.argtypes = [C.c_void_p, C.c_char_p]
+face_recognition.recognizeFacesInSession.argtypes = [C.c_void_p, C.POINTER(C.c_ubyte), C.c_int, C.c_int,
+                                                     C.POINTER(C.c_ubyte), C.POINTER(C.c_ubyte)]
+face_recognition.recognizeFacesInSessionWithDeadline.argtypes = [C.c_void_p, C.POINTER(C.c_ubyte), C.c_int, C.c_int,
+                                                                 C.POINTER(C.c_ubyte), C.POINTER(C.c_ubyte),
+                                                                 C.c_double, C.c_int, C.c_int]
+for scheduling in (face_recognition.getEngineSchedulingStats, face_recognition.getShardedEngineSchedulingStats):
+    scheduling.argtypes = [C.c_void_p, C.POINTER(C.c_ulonglong)]
+face_recognition.getEngineStartupStats.argtypes = [C.c_void_p, C.POINTER(C.c_double)]
+face_recognition.getEngineQueueStats.argtypes = [C.c_void_p, C.c_char_p, C.c_int, C.POINTER(C.c_ulonglong), C.c_int]
+face_recognition.swapEngineModel.argtypes = [C.c_void_p, C.c_int, C.c_char_p, C.c_char_p]
+face_recognition.enrollEngineGallery.argtypes = [C.c_void_p, C.c_char_p, C.POINTER(C.POINTER(C.c_ubyte)),
+                                                 C.POINTER(C.c_int), C.POINTER(C.c_int), C.POINTER(C.c_int), C.c_int,
+                                                 C.POINTER(C.c_char_p), C.c_int]
+face_recognition.getSessionRecognitionTime.restype = C.c_double
+face_recognition.getSessionRecognitionTime.argtypes = [C.c_void_p]
+face_recognition.getSessionFaces.argtypes = [C.c_void_p, C.POINTER(C.c_int), C.c_int]
+face_recognition.getSessionFaceLabel.restype = C.c_char_p
+face_recognition.getSessionFaceLabel.argtypes = [C.c_void_p, C.c_int]
+
+PRIORITIES = {'bulk': 0, 'normal': 1, 'interactive': 2}
+MODELS = {'face_detection': 1, 'facial_landmarks': 2, 'feature_extraction': 4}
+
+GALLERY_PLACEMENTS = {'local': 0, 'interleaved': 1, 'replicated': 2}
+MAX_NODES = 64
+MAX_QUEUES = 8
+QUEUE_NAME_SIZE = 32
+QUEUE_FIELDS = ('capacity', 'depth', 'high_water', 'pushed', 'popped', 'dropped', 'blocked')
+
+def gallery_bandwidth(function, handle):
+    """Per NUMA node gallery scan counters: [(scans, bytes, milliseconds, GB/s, TLB misses)]."""
+    scans = (C.c_ulonglong * MAX_NODES)()
+    scanned = (C.c_ulonglong * MAX_NODES)()
+    milliseconds = (C.c_double * MAX_NODES)()
+    tlb_misses = (C.c_ulonglong * MAX_NODES)()
+    nodes = min(function(handle, scans, scanned, milliseconds, tlb_misses, MAX_NODES), MAX_NODES)
+    return [(scans[n], scanned[n], milliseconds[n], scanned[n] / (milliseconds[n] * 1e6) if milliseconds[n] else 0.0,
+             tlb_misses[n])
+            for n in range(nodes)]
+
+MAX_STAGES = 64
+
+def allocation_stats():
+    """Heap allocations per pipeline stage since the last start: {stage: (allocations, bytes)}, frames."""
+    names = C.create_string_buffer(32 * MAX_STAGES)
+    allocations = (C.c_ulonglong * MAX_STAGES)()
+    allocated = (C.c_ulonglong * MAX_STAGES)()
+    frames = C.c_ulonglong()
+    stages = min(face_recognition.getAllocationStats(names, allocations, allocated, C.byref(frames), MAX_STAGES),
+                 MAX_STAGES)
+    return ({names.raw[32 * i:32 * (i + 1)].rstrip(b'\0').decode(): (allocations[i], allocated[i])
+             for i in range(stages)}, frames.value)
+
+def verify_allocations(image, engine=None, warmup=10, frames=100, budget=0.0, budgets=None):
+    """Fails when a pipeline stage allocates more than its budget per frame after warm-up.
+    Requires the library built with ENABLE_ALLOCATION_TRACKING."""
+    for (stage, allocations) in (budgets or {}).items():
+        face_recognition.setAllocationBudget(stage.encode(), allocations)
+    (rows, cols, depth) = image.shape
+    result = face_recognition.verifyAllocations(engine and engine.handle,
+                                                image.ctypes.data_as(C.POINTER(C.c_ubyte)), rows, cols,
+                                                warmup, frames, budget)
+    if result < 0:
+        raise RuntimeError('Allocation verification failed to run')
+    return result == 0
+
+def engine_options(options):
+    return ','.join('%s=%s' % option for option in sorted(options.items())).encode()
+
+def scheduling_stats(function, handle):
+    """Frames recognized, dropped for their deadline, shed from a full queue and re-verifications dropped."""
+    counters = (C.c_ulonglong * 4)()
+    function(handle, counters)
+    return dict(zip(('recognized', 'expired', 'shed', 'reverifications_dropped'), counters))
+
+class Engine:
+    """Handle based API: one engine, one session per calling thread."""
+
+    def __init__(self, infer_requests=2, device=None, **options):
+        """options are further EngineConfig fields, e.g. detectionBatch=16, embeddingBatch=8."""
+        self.handle = face_recognition.createEngineWithOptions(
+            None, None, None, device and device.encode(), engine_options(dict(options, inferRequests=infer_requests)))
+        if not self.handle:
+            raise RuntimeError('Cannot create face recognition engine')
+
+    def close(self):
+        face_recognition.destroyEngine(self.handle)
+        self.handle = None
+
+    def session(self):
+        return Session(self)
+
+    def gallery_bandwidth(self):
+        return gallery_bandwidth(face_recognition.getEngineGalleryBandwidth, self.handle)
+
+    def scheduling_stats(self):
+        return scheduling_stats(face_recognition.getEngineSchedulingStats, self.handle)
+
+    def queue_stats(self):
+        """Per stage queue: capacity (0 is unbounded), depth, high water mark and push/pop/drop/block counts.
+        The stage with the deepest queue is the bottleneck."""
+        names = C.create_string_buffer(MAX_QUEUES * QUEUE_NAME_SIZE)
+        counters = (C.c_ulonglong * (MAX_QUEUES * len(QUEUE_FIELDS)))()
+        count = min(face_recognition.getEngineQueueStats(self.handle, names, QUEUE_NAME_SIZE, counters, MAX_QUEUES),
+                    MAX_QUEUES)
+        fields = len(QUEUE_FIELDS)
+        return {names.raw[i * QUEUE_NAME_SIZE:(i + 1) * QUEUE_NAME_SIZE].split(b'\0', 1)[0].decode():
+                dict(zip(QUEUE_FIELDS, counters[i * fields:(i + 1) * fields])) for i in range(count)}
+
+    def startup_stats(self):
+        """Cold start milliseconds: plugin, each network, all networks, the first frame (0 before it) and warm-up."""
+        durations = (C.c_double * 7)()
+        face_recognition.getEngineStartupStats(self.handle, durations)
+        return dict(zip(('plugin', 'face_detection', 'facial_landmarks', 'feature_extraction', 'models',
+                         'first_frame', 'warm_up'), durations))
+
+    def swap_model(self, model, path, gallery=None):
+        """Swaps the network of model for the one of path while serving; 'feature_extraction' requires
+        the gallery file enrolled with it. Returns once the frames on the previous network are done."""
+        if face_recognition.swapEngineModel(self.handle, MODELS[model], path.encode(),
+                                            gallery and gallery.encode()) != 0:
+            raise RuntimeError('Cannot swap the %s network for %s' % (model, path))
+
+    def enroll(self, path, faces):
+        """Saves to path the gallery of faces, (label, image) pairs of BGR face images, best the aligned ones
+        of a recognition, embedded by the current feature extraction network; swap_model() accepts it
+        with that network."""
+        faces = [(label, np.ascontiguousarray(image)) for label, image in faces]
+        labels = list(dict.fromkeys(label for label, _ in faces))
+        count = len(faces)
+        data = (C.POINTER(C.c_ubyte) * count)(*[image.ctypes.data_as(C.POINTER(C.c_ubyte)) for _, image in faces])
+        rows = (C.c_int * count)(*[image.shape[0] for _, image in faces])
+        cols = (C.c_int * count)(*[image.shape[1] for _, image in faces])
+        face_labels = (C.c_int * count)(*[labels.index(label) for label, _ in faces])
+        names = (C.c_char_p * len(labels))(*[label.encode() for label in labels])
+        if face_recognition.enrollEngineGallery(self.handle, path.encode(), data, rows, cols, face_labels, count,
+                                                names, len(labels)) != 0:
+            raise RuntimeError('Cannot enroll the gallery %s' % path)
+
+    def detection_stats(self):
+        """Batched face detection inferences and frames detected by them."""
+        batches = C.c_ulonglong()
+        frames = C.c_ulonglong()
+        face_recognition.getEngineDetectionStats(self.handle, C.byref(batches), C.byref(frames))
+        return batches.value, frames.value
+
+    def embedding_stats(self):
+        """Batched embedding inferences, faces, full batches and the batch fill rate."""
+        batches = C.c_ulonglong()
+        faces = C.c_ulonglong()
+        full_batches = C.c_ulonglong()
+        batch_size = face_recognition.getEngineEmbeddingStats(self.handle, C.byref(batches), C.byref(faces),
+                                                              C.byref(full_batches))
+        fill_rate = faces.value / (batches.value * batch_size) if batches.value else 0.0
+        return batches.value, faces.value, full_batches.value, fill_rate
+
+class ShardedEngine:
+    """Thread-per-core serving: sessions of one stream always run on the same pinned shard."""
+
+    def __init__(self, shards=0, device=None, gallery=None, placement='replicated', **options):
+        """options are EngineConfig fields of the shard engines, e.g. maxQueuedFrames=4."""
+        self.handle = face_recognition.createShardedEngine(None, None, None, device and device.encode(), shards,
+                                                           gallery and gallery.encode(), GALLERY_PLACEMENTS[placement],
+                                                           engine_options(options))
+        if not self.handle:
+            raise RuntimeError('Cannot create sharded face recognition engine')
+
+    def close(self):
+        face_recognition.destroyShardedEngine(self.handle)
+        self.handle = None
+
+    def session(self, stream):
+        return Session(self, stream)
+
+    def gallery_bandwidth(self):
+        return gallery_bandwidth(face_recognition.getShardedEngineGalleryBandwidth, self.handle)
+
+    def scheduling_stats(self):
+        return scheduling_stats(face_recognition.getShardedEngineSchedulingStats, self.handle)
+
+class Session:
+    MAX_FACES = 256
+
+    def __init__(self, engine, stream=None):
+        if stream is None:
+            self.handle = face_recognition.createSession(engine.handle)
+        else:
+            self.handle = face_recognition.createStreamSession(engine.handle, stream.encode())
+
+    def close(self):
+        face_recognition.destroySession(self.handle)
+        self.handle = None
+
+    def recognize(self, image, deadline=None, reverification=False, priority='normal'):
+        """deadline in milliseconds from now; returns None when the frame is dropped to meet it
+        or shed under overload. reverification frames are served after fresh ones; priority is one
+        of PRIORITIES, interactive frames may use the engine's reserved infer requests."""
+        (rows, cols, depth) = image.shape
+        detection_results = np.empty_like(image)
+        recognition_results = np.empty_like(image)
+        result = face_recognition.recognizeFacesInSessionWithDeadline(
+            self.handle, image.ctypes.data_as(C.POINTER(C.c_ubyte)), rows, cols,
+            detection_results.ctypes.data_as(C.POINTER(C.c_ubyte)),
+            recognition_results.ctypes.data_as(C.POINTER(C.c_ubyte)), deadline or 0.0, PRIORITIES[priority],
+            int(reverification))
+        if result < 0:
+            raise RuntimeError('Face recognition failed')
+        if result == 1:
+            return None
+
+        rects = np.zeros(dtype=np.int32, shape=(self.MAX_FACES, 4))
+        count = min(face_recognition.getSessionFaces(self.handle, rects.ctypes.data_as(C.POINTER(C.c_int)),
+                                                     self.MAX_FACES), self.MAX_FACES)
+        faces = [(tuple(rects[i]), face_recognition.getSessionFaceLabel(self.handle, i).decode())
+                 for i in range(count)]
+        return detection_results, recognition_results, faces, face_recognition.getSessionRecognitionTime(self.handle)
+
+# Mirrors the structs in include/shared_ring.hpp
+RING_HEADER = np.dtype([('magic', '<u4'), ('version', '<u4'), ('slot_count', '<u4'),
+                        ('max_rows', '<u4'), ('max_cols', '<u4'), ('max_faces', '<u4'),
+                        ('frame_slot_size', '<u8'), ('result_slot_size', '<u8'),
+                        ('frames_offset', '<u8'), ('results_offset', '<u8'), ('reserved', '<u8')])
+RESULT_HEADER = np.dtype([('rows', '<u4'), ('cols', '<u4'), ('face_count', '<u4'), ('truncated', '<u4'),
+                          ('recognition_time', '<f8'), ('detection_offset', '<u8'),
+                          ('recognition_offset', '<u8'), ('aligned_offset', '<u8'),
+                          ('aligned_capacity', '<u8'), ('reserved', '<u8')])
+FACE_RECORD = np.dtype([('x', '<i4'), ('y', '<i4'), ('width', '<i4'), ('height', '<i4'),
+                        ('aligned_rows', '<u4'), ('aligned_cols', '<u4'), ('aligned_offset', '<u8'),
+                        ('label', 'S32')])
+
+class SharedRing:
+    """Zero-copy frame/result exchange through the engine's shared memory ring.
+
+    slot = ring.acquire()
+    ring.frame(slot, rows, cols)[...] = image   # or decode straight into the view
+    ring.recognize(slot, rows, cols)
+    detects, recogns, faces = ring.results(slot)
+    ring.release(slot)                          # views of the slot are invalid afterwards
+
+    The views returned by frame() and results() map the segment; close() raises BufferError
+    while any of them is alive, drop them first.
+    """
+
+    def __init__(self, name='/face_recognition', slots=4, max_rows=1080, max_cols=1920, max_faces=64):
+        if face_recognition.createSharedRing(name.encode(), slots, max_rows, max_cols, max_faces) != 0:
+            raise RuntimeError('Cannot create shared ring ' + name)
+        fd = os.open('/dev/shm/' + name.lstrip('/'), os.O_RDWR)
+        try:
+            self._mm = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+        self._buffer = np.frombuffer(self._mm, dtype=np.uint8)
+        self.header = self._buffer[:RING_HEADER.itemsize].view(RING_HEADER)[0]
+
+    def close(self):
+        """Unmaps the ring, BufferError while views of it are alive."""
+        self.header = None
+        self._buffer = None
+        self._mm.close()
+        face_recognition.destroySharedRing()
+
+    def acquire(self):
+        slot = face_recognition.acquireSlot()
+        if slot < 0:
+            raise RuntimeError('No free shared ring slot')
+        return slot
+
+    def release(self, slot):
+        face_recognition.releaseSlot(slot)
+
+    def frame(self, slot, rows, cols):
+        start = int(self.header['frames_offset'] + slot * self.header['frame_slot_size'])
+        return self._buffer[start:start + rows * cols * 3].reshape(rows, cols, 3)
+
+    def recognize(self, slot, rows, cols):
+        if face_recognition.recognizeFacesInSlot(slot, rows, cols) != 0:
+            raise RuntimeError('Face recognition failed for slot ' + str(slot))
+
+    def results(self, slot):
+        start = int(self.header['results_offset'] + slot * self.header['result_slot_size'])
+        result = self._buffer[start:start + RESULT_HEADER.itemsize].view(RESULT_HEADER)[0]
+        rows, cols = int(result['rows']), int(result['cols'])
+
+        def image(offset):
+            offset = start + int(offset)
+            return self._buffer[offset:offset + rows * cols * 3].reshape(rows, cols, 3)
+
+        records_start = start + RESULT_HEADER.itemsize
+        records = self._buffer[records_start:records_start + int(result['face_count']) * FACE_RECORD.itemsize]
+        aligned_start = start + int(result['aligned_offset'])
+
+        faces = []
+        for record in records.view(FACE_RECORD):
+            aligned = None
+            if record['aligned_rows']:
+                offset = aligned_start + int(record['aligned_offset'])
+                shape = (int(record['aligned_rows']), int(record['aligned_cols']), 3)
+                aligned = self._buffer[offset:offset + shape[0] * shape[1] * 3].reshape(shape)
+            faces.append({'location': (int(record['x']), int(record['y']), int(record['width']), int(record['height'])),
+                          'label': record['label'].decode(),
+                          'aligned': aligned})
+
+        return image(result['detection_offset']), image(result['recognition_offset']), faces
+
 if __name__ == '__main__':
     image_path = get_parser().parse_args().path   
     image = cv2.imread(image_path)
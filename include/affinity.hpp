@@ -0,0 +1,13 @@
+# pragma once
+
+#include <vector>
+
+// Cores the process is allowed to run on, in ascending order.
+std::vector<int> availableCores();
+
+// Restricts the calling thread to the given cores. Returns false when the
+// platform does not support it or the cores are not available.
+bool pinCurrentThread(const std::vector<int> &cores);
+
+// NUMA node of a core, 0 when the topology is unknown.
+int coreNode(int core);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <opencv2/opencv.hpp>
 
 const double DESIRED_LEFT_EYE_X = 0.16;     // Controls how much of the face is visible after preprocessing.
@@ -11,4 +13,6 @@ const double FACE_ELLIPSE_H = 0.80; // Controls how tall the face mask is.
 const int DESIRED_FACE_WIDTH = 70;
 const int DESIRED_FACE_HEIGHT = DESIRED_FACE_WIDTH;
 
-cv::Mat alignFace(const cv::Mat &srcImage, std::vector<cv::Point2f> leftEye, std::vector<cv::Point2f> rightEye);
+// Writes the aligned face into dstFace, scaled to its preallocated size.
+bool alignFace(const cv::Mat &srcImage, const std::array<cv::Point2f, 2> &leftEye,
+               const std::array<cv::Point2f, 2> &rightEye, cv::Mat &dstFace);
@@ -0,0 +1,58 @@
+# pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap allocation accounting per pipeline stage, compiled in with the
+// ENABLE_ALLOCATION_TRACKING CMake option (FACE_RECOGNITION_ALLOCATION_TRACKING).
+// malloc, calloc, realloc, the aligned variants and operator new are interposed and every
+// allocation is charged to the stage on top of the calling thread's stage stack, "other"
+// when it is empty. Timer::Scope charges its timed scope as a stage, and TaskScheduler::parallelFor()
+// charges its tasks to the stage of the caller.
+//
+// Allocations of the library itself are always counted; LD_PRELOAD it to also count the
+// ones made inside OpenCV and the Inference Engine. Without the option every call is a no-op.
+class AllocationTracker {
+public:
+    struct StageStats {
+        std::string name;
+        uint64_t allocations;
+        uint64_t bytes;
+        double budget;      // allocations per frame, negative when unset
+    };
+
+    static bool available();
+
+    // Resets the counters and starts counting, e.g. after warm-up
+    static void start();
+    static void stop();
+    static bool counting();
+
+    static void pushStage(const std::string &name);
+    static void popStage();
+    static int currentStage();
+    static void enterStage(int stage);
+    static void leaveStage();
+
+    // Charges the allocations of its scope to a stage and leaves it even when the scope throws
+    class Stage {
+    public:
+        explicit Stage(const std::string &name) { pushStage(name); }
+        explicit Stage(int stage) { enterStage(stage); }
+        ~Stage() { leaveStage(); }
+
+    private:
+        Stage(const Stage &) = delete;
+        Stage &operator=(const Stage &) = delete;
+    };
+
+    static void frameCompleted();
+    static uint64_t frames();
+
+    static void setBudget(const std::string &stage, double allocationsPerFrame);
+    static std::vector<StageStats> stats();
+    // Logs and returns the number of stages above their budget per frame, or above
+    // defaultBudget for stages without one.
+    static int checkBudget(double defaultBudget);
+};
@@ -0,0 +1,245 @@
+# pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+// What push() does when the queue is full
+enum class QueuePolicy {
+    Block,      // wait for a free slot, the producer is slowed down to the consumer's pace
+    Drop        // reject the new element and count it
+};
+
+struct QueueStats {
+    std::string name;
+    size_t capacity;
+    size_t depth;           // elements queued at the time of the call
+    size_t highWater;       // largest depth seen
+    unsigned long long pushed;
+    unsigned long long popped;
+    unsigned long long dropped;
+    unsigned long long blocked;     // pushes which had to wait for a slot
+};
+
+// Counters of a buffer which is not a queue of this file but is kept by its owner under
+// its own mutex, e.g. the frames pending for a batch. Not synchronized.
+class QueueMeter {
+public:
+    QueueMeter(const std::string &name, size_t capacity) : _stats {name, capacity, 0, 0, 0, 0, 0, 0} {}
+
+    void pushed(size_t depth) {
+        ++_stats.pushed;
+        _stats.highWater = std::max(_stats.highWater, depth);
+    }
+    void popped(size_t count = 1) { _stats.popped += count; }
+    void dropped() { ++_stats.dropped; }
+    void blocked() { ++_stats.blocked; }
+
+    QueueStats stats(size_t depth) const {
+        QueueStats stats = _stats;
+        stats.depth = depth;
+        return stats;
+    }
+
+private:
+    QueueStats _stats;
+};
+
+// Counters and the sleeping side of the queues. push() and pop() spin
+// briefly and then sleep on a condition variable, which producers and consumers only
+// touch when a sleeper is registered.
+class QueueBase {
+public:
+    QueueBase(const std::string &name, size_t capacity, QueuePolicy policy)
+        : _name(name), _capacity(capacity), _policy(policy), _highWater(0), _pushed(0), _popped(0), _dropped(0),
+          _blocked(0), _closed(false), _sleepers(0) {}
+
+    const std::string &name() const { return _name; }
+    size_t capacity() const { return _capacity; }
+    QueuePolicy policy() const { return _policy; }
+
+    // Wakes every blocked push() and pop(); pop() drains the remaining elements, push() fails
+    void close() {
+        _closed = true;
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _changed.notify_all();
+    }
+    bool closed() const { return _closed; }
+
+protected:
+    static const int SPINS = 64;
+
+    void pushed(size_t depth) {
+        _pushed.fetch_add(1, std::memory_order_relaxed);
+        size_t highWater = _highWater.load(std::memory_order_relaxed);
+        while (depth > highWater && !_highWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed)) {}
+        wake();
+    }
+    void popped() {
+        _popped.fetch_add(1, std::memory_order_relaxed);
+        wake();
+    }
+    // The fences order the publication of an element against the registration of a
+    // sleeper: either the waker sees the sleeper or the sleeper sees the element.
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_sleepers.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _changed.notify_all();
+        }
+    }
+    template <typename Ready>
+    void sleep(int spin, Ready ready) {
+        if (spin < SPINS) {
+            std::this_thread::yield();
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready() && !_closed) {
+            _changed.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        _sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    QueueStats stats(size_t depth) const {
+        return QueueStats {_name, _capacity, depth, _highWater.load(), _pushed.load(), _popped.load(),
+                           _dropped.load(), _blocked.load()};
+    }
+
+    const std::string _name;
+    const size_t _capacity;
+    const QueuePolicy _policy;
+    std::atomic<size_t> _highWater;
+    std::atomic<unsigned long long> _pushed;
+    std::atomic<unsigned long long> _popped;
+    std::atomic<unsigned long long> _dropped;
+    std::atomic<unsigned long long> _blocked;
+    std::atomic<bool> _closed;
+    std::atomic<int> _sleepers;
+    std::mutex _sleepMutex;
+    std::condition_variable _changed;
+};
+
+// Lock-free bounded queue for any number of producers and consumers (Vyukov's array
+// queue): every slot carries a sequence number telling whether it is free for the
+// producer or full for the consumer of a given lap, so tryPush() and tryPop() are a
+// single compare-and-swap on the shared position plus one release store.
+// The capacity is rounded up to a power of two.
+template <typename T>
+class MpmcQueue : public QueueBase {
+public:
+    MpmcQueue(const std::string &name, size_t capacity, QueuePolicy policy = QueuePolicy::Block)
+        : QueueBase(name, roundUp(capacity), policy), _mask(_capacity - 1), _cells(new Cell[_capacity]),
+          _enqueuePosition(0), _dequeuePosition(0) {
+        for (size_t i = 0; i < _capacity; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(T &value) {
+        size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = _cells[position & _mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+            if (difference == 0) {
+                if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    pushed(depth());
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = _enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T &value) {
+        size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = _cells[position & _mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position + 1);
+            if (difference == 0) {
+                if (_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + _capacity, std::memory_order_release);
+                    popped();
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = _dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false when the element was dropped by the policy or the queue is closed;
+    // value is left untouched then.
+    bool push(T &value) {
+        bool waited = false;
+        for (int spin = 0; ; ++spin) {
+            if (_closed) return false;
+            if (tryPush(value)) return true;
+            if (_policy == QueuePolicy::Drop) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (!waited) {
+                _blocked.fetch_add(1, std::memory_order_relaxed);
+                waited = true;
+            }
+            sleep(spin, [this] { return depth() < _capacity; });
+        }
+    }
+
+    // Waits for an element, returns false once the queue is closed and drained
+    bool pop(T &value) {
+        for (int spin = 0; ; ++spin) {
+            if (tryPop(value)) return true;
+            if (_closed && depth() == 0) return false;
+            sleep(spin, [this] { return depth() > 0; });
+        }
+    }
+
+    size_t depth() const {
+        const size_t enqueued = _enqueuePosition.load(std::memory_order_relaxed);
+        const size_t dequeued = _dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    QueueStats stats() const { return QueueBase::stats(depth()); }
+
+private:
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t roundUp(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    const size_t _mask;
+    std::unique_ptr<Cell[]> _cells;
+    std::atomic<size_t> _enqueuePosition;
+    std::atomic<size_t> _dequeuePosition;
+};
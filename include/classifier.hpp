@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <iterator>
 #include <map>
+#include <memory>
 
 #include <inference_engine.hpp>
 
@@ -17,6 +18,18 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "gallery.hpp"
+#include "gallery_replicas.hpp"
+
+// Nearest neighbour by angle over every embedding of the gallery copy local to the
+// calling thread.
 struct Classification {
-    std::string classify(std::vector<float> featureVector);
+    std::shared_ptr<GalleryReplicas> replicas;
+
+    // Uses the built-in gallery when none is given
+    explicit Classification(std::shared_ptr<GalleryReplicas> replicas = nullptr);
+
+    std::string classify(const std::vector<float> &featureVector) const;
+    // Assigns the label in place, which does not allocate when it fits into label's capacity
+    void classify(const float *featureVector, size_t size, std::string &label) const;
 };
@@ -0,0 +1,375 @@
+# pragma once
+
+// C++20 coroutine interface of the recognition stages, for services composing their
+// own per-request flows:
+//
+//   Task<void> identify(AsyncFaceDetector &detector, AsyncLandmarksEstimator &landmarks,
+//                       AsyncFeatureExtractor &extractor, const cv::Mat &frame) {
+//       const auto &faces = co_await detector.detect(frame);
+//       ...
+//       LandmarksBatch points = co_await landmarks.run(crops);
+//       ...
+//       std::vector<float> embeddings = co_await extractor.embed(aligned);
+//   }
+//   spawn(identify(...), [](std::exception_ptr error) { ... });
+//
+// An awaited stage starts its infer request and suspends; the completion callback of the
+// request hands the coroutine to the executor, which resumes it. No thread waits for an
+// inference. One model wrapper serves one flow at a time, as its infer request does.
+//
+// The library itself is C++11: this header is enabled by FACE_RECOGNITION_COROUTINES
+// (CMake option ENABLE_COROUTINES) and needs a C++20 compiler on the including side.
+
+#if defined(FACE_RECOGNITION_COROUTINES)
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "coroutines.hpp requires C++20 coroutines, compile with -std=c++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "detectors.hpp"
+#include "engine.hpp"
+#include "feature_extractor.hpp"
+#include "task_scheduler.hpp"
+
+// Where a coroutine suspended on an inference is resumed
+class Executor {
+public:
+    virtual ~Executor() {}
+    // Called on the inference thread which completed the request
+    virtual void post(std::coroutine_handle<> handle) = 0;
+};
+
+// Resumes on the completing thread, for short continuations
+class InlineExecutor : public Executor {
+public:
+    void post(std::coroutine_handle<> handle) override { handle.resume(); }
+};
+
+// Resumes as a task of the CPU scheduler of the pipeline stages
+class SchedulerExecutor : public Executor {
+public:
+    explicit SchedulerExecutor(TaskScheduler &scheduler) : _scheduler(scheduler) {}
+    void post(std::coroutine_handle<> handle) override {
+        _scheduler.submit([handle] { handle.resume(); });
+    }
+
+private:
+    TaskScheduler &_scheduler;
+};
+
+// Lazily started coroutine returning T, awaited by another one or started by spawn()
+template <typename T>
+class Task;
+
+namespace coroutines {
+
+template <typename T>
+struct Promise;
+
+// Resumes the awaiting coroutine when the task is done, without growing the stack
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+    T take() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+}  // namespace coroutines
+
+template <typename T>
+class Task {
+public:
+    using promise_type = coroutines::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+    Task(Task &&other) noexcept : _handle(std::exchange(other._handle, {})) {}
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (_handle) _handle.destroy();
+            _handle = std::exchange(other._handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (_handle) _handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        _handle.promise().continuation = awaiting;
+        return _handle;
+    }
+    T await_resume() { return _handle.promise().take(); }
+
+private:
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+namespace coroutines {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Frame of a spawned task, destroyed when it completes
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+inline Detached run(Task<void> task, std::function<void(std::exception_ptr)> done) {
+    std::exception_ptr error;
+    try {
+        co_await task;
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    done(error);
+}
+
+inline void checkStatus(InferenceEngine::StatusCode status, const std::string &stage) {
+    if (status != InferenceEngine::StatusCode::OK) {
+        throw std::runtime_error(stage + " inference failed with status " + std::to_string(status));
+    }
+}
+
+inline int enqueued(const FaceDetection &model) { return model.enquedFrames; }
+inline int enqueued(const FacialLandmarksDetection &model) { return model.enquedFaces; }
+inline int enqueued(const FeatureExtraction &model) { return model.enquedFrames; }
+
+// Starts the request of model on await and resumes through executor once it completed.
+// With nothing enqueued, or a disabled model, submitRequest() would not start the request
+// and no completion would ever resume the coroutine: it continues inline, not submitted.
+template <typename Model>
+struct InferenceAwaiter {
+    Model &model;
+    Executor &executor;
+    std::coroutine_handle<> handle;
+    InferenceEngine::StatusCode status;
+    bool submitted;
+
+    InferenceAwaiter(Model &model, Executor &executor)
+        : model(model), executor(executor), status(InferenceEngine::StatusCode::OK), submitted(false) {}
+
+    bool await_ready() const { return !model.enabled() || enqueued(model) == 0; }
+    // The coroutine may be resumed before submitRequest() returns, nothing of the
+    // awaiter is touched after it
+    void await_suspend(std::coroutine_handle<> suspended) {
+        handle = suspended;
+        submitted = true;
+        InferenceAwaiter *self = this;
+        model.completion = [self](InferenceEngine::StatusCode result) {
+            self->status = result;
+            self->executor.post(self->handle);
+        };
+        model.submitRequest();
+    }
+};
+
+}  // namespace coroutines
+
+// Runs task to completion without an awaiting coroutine; done gets the exception which
+// failed it, if any, on the thread finishing it
+inline void spawn(Task<void> task, std::function<void(std::exception_ptr)> done) {
+    coroutines::run(std::move(task), std::move(done));
+}
+
+class AsyncFaceDetector {
+public:
+    AsyncFaceDetector(FaceDetection &detector, Executor &executor) : _detector(detector), _executor(executor) {}
+
+    struct DetectAwaiter : coroutines::InferenceAwaiter<FaceDetection> {
+        using InferenceAwaiter::InferenceAwaiter;
+        // Valid until the next detection
+        const std::vector<FaceDetection::Result> &await_resume() {
+            coroutines::checkStatus(status, model.topoName);
+            if (submitted) {
+                model.fetchResults();
+            } else {
+                model.results.clear();
+            }
+            return model.results;
+        }
+    };
+
+    // Faces detected on frame, which shall live until the detection completes
+    DetectAwaiter detect(const cv::Mat &frame) {
+        _detector.enqueue(frame);
+        return DetectAwaiter(_detector, _executor);
+    }
+
+private:
+    FaceDetection &_detector;
+    Executor &_executor;
+};
+
+class AsyncLandmarksEstimator {
+public:
+    AsyncLandmarksEstimator(FacialLandmarksDetection &estimator, Executor &executor)
+        : _estimator(estimator), _executor(executor) {}
+
+    struct RunAwaiter : coroutines::InferenceAwaiter<FacialLandmarksDetection> {
+        int faces;
+
+        RunAwaiter(FacialLandmarksDetection &model, Executor &executor, int faces)
+            : InferenceAwaiter(model, executor), faces(faces) {}
+        // Views into the output blob, valid until the next run
+        LandmarksBatch await_resume() {
+            coroutines::checkStatus(status, model.topoName);
+            return submitted ? model.landmarks(faces) : LandmarksBatch {nullptr, 0, 0};
+        }
+    };
+
+    // Landmarks of the faces, at most maxBatch of them are estimated
+    RunAwaiter run(const std::vector<cv::Mat> &faces) {
+        for (const cv::Mat &face : faces) {
+            _estimator.enqueue(face);
+        }
+        return RunAwaiter(_estimator, _executor, _estimator.enquedFaces);
+    }
+
+private:
+    FacialLandmarksDetection &_estimator;
+    Executor &_executor;
+};
+
+class AsyncFeatureExtractor {
+public:
+    AsyncFeatureExtractor(FeatureExtraction &extractor, Executor &executor)
+        : _extractor(extractor), _executor(executor) {}
+
+    // One row of featureVectorSize values per face, zeros with a disabled extractor. Faces
+    // beyond the batch of the extractor are embedded by further inferences, one after the other.
+    Task<std::vector<float>> embed(const std::vector<cv::Mat> &faces) {
+        const size_t featureVectorSize = _extractor.featureVectorSize;
+        std::vector<float> embeddings(faces.size() * featureVectorSize);
+        for (size_t first = 0; first < faces.size(); first += _extractor.maxBatch) {
+            const size_t count = std::min<size_t>(_extractor.maxBatch, faces.size() - first);
+            for (size_t i = 0; i < count; ++i) {
+                _extractor.enqueue(faces[first + i]);
+            }
+            if (!co_await EmbedAwaiter(_extractor, _executor)) break;
+            _extractor.fetchResults();
+            std::copy(_extractor.results.begin(), _extractor.results.end(),
+                      embeddings.begin() + first * featureVectorSize);
+        }
+        co_return embeddings;
+    }
+
+private:
+    struct EmbedAwaiter : coroutines::InferenceAwaiter<FeatureExtraction> {
+        using InferenceAwaiter::InferenceAwaiter;
+        // Whether the chunk was inferred
+        bool await_resume() {
+            coroutines::checkStatus(status, model.topoName);
+            return submitted;
+        }
+    };
+
+    FeatureExtraction &_extractor;
+    Executor &_executor;
+};
+
+// co_await recognize(engine, executor, ...) runs the whole pipeline of
+// FaceRecognitionEngine::recognizeAsync() and resumes through executor once it is done.
+// Waiting for a free context still blocks the awaiting thread.
+class RecognizeAwaiter {
+public:
+    RecognizeAwaiter(FaceRecognitionEngine &engine, Executor &executor, const cv::Mat &image,
+                     cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage, RecognitionResult &recognition,
+                     const FrameOptions &options)
+        : _engine(engine), _executor(executor), _image(image), _detectedFacesImage(detectedFacesImage),
+          _recognizedFacesImage(recognizedFacesImage), _recognition(recognition), _options(options) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        _handle = handle;
+        RecognizeAwaiter *self = this;
+        _engine.recognizeAsync(_image, _detectedFacesImage, _recognizedFacesImage, _recognition, _options,
+                               [self](std::exception_ptr error) {
+                                   self->_error = error;
+                                   self->_executor.post(self->_handle);
+                               });
+    }
+    void await_resume() {
+        if (_error) std::rethrow_exception(_error);
+    }
+
+private:
+    FaceRecognitionEngine &_engine;
+    Executor &_executor;
+    const cv::Mat &_image;
+    cv::Mat &_detectedFacesImage;
+    cv::Mat &_recognizedFacesImage;
+    RecognitionResult &_recognition;
+    const FrameOptions _options;
+    std::coroutine_handle<> _handle;
+    std::exception_ptr _error;
+};
+
+inline RecognizeAwaiter recognize(FaceRecognitionEngine &engine, Executor &executor, const cv::Mat &image,
+                                  cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                                  RecognitionResult &recognition, const FrameOptions &options = FrameOptions()) {
+    return RecognizeAwaiter(engine, executor, image, detectedFacesImage, recognizedFacesImage, recognition, options);
+}
+
+#endif  // FACE_RECOGNITION_COROUTINES
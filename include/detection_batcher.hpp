@@ -0,0 +1,89 @@
+# pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "bounded_queue.hpp"
+#include "detectors.hpp"
+
+// Detects faces on the frames of concurrent callers (e.g. one serving thread per camera
+// stream) in one batched inference. The first frame of a batch waits up to the window for
+// others to join, the batch runs as soon as it is full or the window has passed, with a
+// dynamic batch of the frames collected, and every caller's completion is called once the
+// results of its frame are in. Batches are started by a dispatcher thread of the batcher,
+// callers never wait for them; they only wait for room while capacity frames are queued.
+class DetectionBatcher {
+public:
+    struct Stats {
+        unsigned long long batches;
+        unsigned long long frames;
+    };
+
+    typedef std::function<void(InferenceEngine::StatusCode)> Completion;
+
+    // detector shall be loaded with a maxBatch of at least batchSize; requests batches
+    // may run at the same time and capacity frames wait for them.
+    DetectionBatcher(const FaceDetection &detector, int requests, int batchSize, double windowMilliseconds,
+                     int capacity);
+    // Runs the frames still queued and waits for the batches in flight
+    ~DetectionBatcher();
+
+    // Runs inferences synthetic inferences on every infer request at every batch size,
+    // before the first detect()
+    void warmUp(int inferences);
+
+    // Queues frame for the next batch and returns. results is replaced with the faces
+    // detected on frame before done is called, with the status of the batch, on the thread
+    // completing its inference. frame, results and done shall stay valid until then; done
+    // shall not throw.
+    void detect(const cv::Mat &frame, std::vector<FaceDetection::Result> &results, const Completion &done);
+
+    int batchSize() const;
+    Stats stats() const;
+    // Of the frames waiting for a batch, named "detection"
+    QueueStats queueStats() const;
+
+private:
+    DetectionBatcher(const DetectionBatcher &) = delete;
+    DetectionBatcher &operator=(const DetectionBatcher &) = delete;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Item {
+        const cv::Mat *frame;
+        std::vector<FaceDetection::Result> *results;
+        const Completion *done;
+        Clock::time_point deadline;     // arrival plus the window
+    };
+
+    // An infer request with the frames of the batch it runs
+    struct Worker {
+        std::unique_ptr<FaceDetection> detector;
+        std::vector<Item> batch;
+    };
+
+    void dispatch();
+    void start(Worker &worker);
+    void finished(Worker &worker, InferenceEngine::StatusCode status);
+
+    const int _batchSize;
+    const std::chrono::microseconds _window;
+    std::vector<Worker> _workers;
+    std::vector<Worker *> _idleWorkers;
+    std::vector<Item> _pending;     // in arrival order
+    const size_t _capacity;
+    QueueMeter _queue;
+    Stats _stats;
+    bool _stopping;
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    std::condition_variable _space;     // frames left _pending
+    std::thread _dispatcher;
+};
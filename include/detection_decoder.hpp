@@ -0,0 +1,26 @@
+# pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Detections of an SSD DetectionOutput blob as a structure of arrays. The blob holds
+// proposals of 7 floats [image_id, label, confidence, xmin, ymin, xmax, ymax] grouped by
+// batch image, and image_id < 0 terminates the valid ones.
+struct DetectionBatch {
+    std::vector<int> image;         // batch index of the detection
+    std::vector<int> label;
+    std::vector<float> confidence;
+    std::vector<float> xmin;        // normed to the image size
+    std::vector<float> ymin;
+    std::vector<float> xmax;
+    std::vector<float> ymax;
+
+    size_t size() const { return confidence.size(); }
+    void reserve(size_t capacity);
+    void clear();
+};
+
+// Appends the proposals above threshold up to the first terminator to batch, whose
+// capacity shall cover proposals for the decoding to allocate nothing. Returns the number
+// of proposals read, terminator excluded.
+size_t decodeDetectionOutput(const float *detections, int proposals, float threshold, DetectionBatch &batch);
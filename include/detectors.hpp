@@ -4,6 +4,7 @@
 
 # pragma once
 
+#include <array>
 #include <functional>
 #include <iostream>
 #include <fstream>
@@ -27,6 +28,10 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "detection_decoder.hpp"
+
+class MappedFile;
+
 // -------------------------Generic routines for detection networks-------------------------------------------------
 
 struct BaseDetection {
@@ -41,6 +46,13 @@ struct BaseDetection {
     const bool isAsync;
     mutable bool enablingChecked;
     mutable bool _enabled;
+    // When set, called with the status of every request started by submitRequest():
+    // on an inference thread in async mode, inline after Infer() otherwise. It shall
+    // hand the post-processing over to another thread instead of running it there,
+    // and the request shall not be waited for then.
+    std::function<void(InferenceEngine::StatusCode)> completion;
+    InferenceEngine::InferRequest *callbackRequest;     // the request completion is installed on
+    std::shared_ptr<const MappedFile> weights;  // .bin mapped for the network, null when it was imported
 
     BaseDetection(std::string topoName,
                   const std::string &pathToModel,
@@ -50,7 +62,8 @@ struct BaseDetection {
     virtual ~BaseDetection();
 
     InferenceEngine::ExecutableNetwork* operator ->();
-    virtual InferenceEngine::CNNNetwork read() = 0;
+    // The topology alone tells the inputs and outputs of a network imported compiled
+    virtual InferenceEngine::CNNNetwork read(bool withWeights = true) = 0;
     virtual void submitRequest();
     virtual void wait();
     bool enabled() const;
@@ -62,6 +75,7 @@ struct FaceDetection : BaseDetection {
         int label;
         float confidence;
         cv::Rect location;
+        int image;              // batch slot of the frame
     };
 
     std::string input;
@@ -71,11 +85,13 @@ struct FaceDetection : BaseDetection {
     int maxProposalCount;
     int objectSize;
     int enquedFrames;
-    float width;
-    float height;
+    int submittedFrames;
+    std::vector<cv::Size> frameSizes;   // of the frames in batch slots 0 .. enquedFrames - 1
     const float bb_enlarge_coefficient;
     bool resultsFetched;
+    cv::Mat resizedFrame;       // reused by enqueue()
     std::vector<std::string> labels;
+    DetectionBatch decoded;     // proposals above the threshold, reused by fetchResults()
     std::vector<Result> results;
 
     FaceDetection(const std::string &pathToModel,
@@ -83,14 +99,43 @@ struct FaceDetection : BaseDetection {
                   int maxBatch, bool isBatchDynamic, bool isAsync,
                   double detectionThreshold, bool doRawOutputMessages);
 
-    InferenceEngine::CNNNetwork read() override;
+    InferenceEngine::CNNNetwork read(bool withWeights = true) override;
     void submitRequest() override;
 
+    // Fills the next batch slot, at most maxBatch frames per request
     void enqueue(const cv::Mat &frame);
+    // Results of all the frames of the request, ordered by batch slot
     void fetchResults();
 };
 
+// Landmarks of one face read in place from the output blob of the landmarks network:
+// (x, y) pairs normed to the face ROI, the eye corners first.
+struct LandmarksView {
+    const float *data;
+    size_t pointCount;
+
+    size_t size() const { return pointCount; }
+    cv::Point2f point(size_t index) const { return cv::Point2f(data[2 * index], data[2 * index + 1]); }
+    // All points in place, valid while the view is
+    const cv::Point2f *points() const { return reinterpret_cast<const cv::Point2f *>(data); }
+    std::array<cv::Point2f, 2> leftEye() const { return {{ point(0), point(1) }}; }
+    std::array<cv::Point2f, 2> rightEye() const { return {{ point(2), point(3) }}; }
+};
+
+// Landmarks of faces 0 .. size() - 1 of a batch, strided views into the output blob
+// valid until the next request is submitted.
+struct LandmarksBatch {
+    const float *data;
+    size_t stride;      // floats per face
+    int faces;
+
+    int size() const { return faces; }
+    LandmarksView operator[](int face) const { return LandmarksView { data + face * stride, stride / 2 }; }
+};
+
 struct FacialLandmarksDetection : BaseDetection {
+    static const size_t POINTS = 35;
+
     std::string input;
     std::string outputFacialLandmarksBlobName;
     int enquedFaces;
@@ -101,9 +146,15 @@ struct FacialLandmarksDetection : BaseDetection {
                              const std::string &deviceForInference,
                              int maxBatch, bool isBatchDynamic, bool isAsync);
 
-    InferenceEngine::CNNNetwork read() override;
+    InferenceEngine::CNNNetwork read(bool withWeights = true) override;
     void submitRequest() override;
 
     void enqueue(const cv::Mat &face);
-    std::vector<float> operator[] (int idx) const;
+    // Values per face of the landmarks output
+    size_t landmarksSize() const;
+    // Views of the normed landmarks of faces 0 .. faces - 1, nothing is copied
+    LandmarksBatch landmarks(int faces) const;
+    // Reserves batch slots 0 .. faces - 1 (at most maxBatch) and returns the input blob,
+    // so that the caller can fill the slots concurrently with matU8ToBlob.
+    InferenceEngine::Blob::Ptr enqueueBatch(int faces);
 };
@@ -0,0 +1,105 @@
+# pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "bounded_queue.hpp"
+#include "feature_extractor.hpp"
+
+// Central micro-batching of the embedding model for all streams of an engine. Aligned
+// faces of concurrent callers are queued together and dispatched as one dynamic batch
+// when batchSize faces are pending or the oldest one has waited for the deadline.
+// Batches are started by a dispatcher thread of the batcher and a caller's completion is
+// called once the batches holding its faces are done, callers never wait for them; they
+// only wait for room while capacity faces are queued.
+class EmbeddingBatcher {
+public:
+    struct Stats {
+        unsigned long long batches;
+        unsigned long long faces;
+        unsigned long long fullBatches;     // dispatched at batchSize, the rest at the deadline
+
+        // Mean share of the batch slots used
+        double fillRate(int batchSize) const {
+            return batches ? double(faces) / (double(batches) * batchSize) : 0.0;
+        }
+    };
+
+    typedef std::function<void(InferenceEngine::StatusCode)> Completion;
+
+    // extractor shall be loaded with a dynamic maxBatch of at least batchSize; requests
+    // batches may run at the same time and capacity faces wait for them.
+    EmbeddingBatcher(const FeatureExtraction &extractor, int requests, int batchSize, double deadlineMilliseconds,
+                     int capacity);
+    // Runs the faces still queued and waits for the batches in flight
+    ~EmbeddingBatcher();
+
+    // As DetectionBatcher::warmUp, before the first embed()
+    void warmUp(int inferences);
+
+    // Queues faces 0 .. count - 1 and returns. Their embeddings are written into rows of
+    // featureVectorSize() floats before done is called, as DetectionBatcher::detect().
+    void embed(const cv::Mat *const *faces, int count, float *embeddings, const Completion &done);
+
+    int batchSize() const;
+    int featureVectorSize() const;
+    Stats stats() const;
+    // Of the faces waiting for a batch, named "feature_extraction"
+    QueueStats queueStats() const;
+
+private:
+    EmbeddingBatcher(const EmbeddingBatcher &) = delete;
+    EmbeddingBatcher &operator=(const EmbeddingBatcher &) = delete;
+
+    typedef std::chrono::steady_clock Clock;
+
+    // An embed() call with faces in flight, pooled
+    struct Caller {
+        int remaining;
+        InferenceEngine::StatusCode status;
+        const Completion *done;
+    };
+
+    struct Item {
+        const cv::Mat *face;
+        float *embedding;
+        Caller *caller;
+        Clock::time_point deadline;
+    };
+
+    // An infer request with the items of the batch it runs, and the callers it completes
+    struct Worker {
+        std::unique_ptr<FeatureExtraction> extractor;
+        std::vector<Item> batch;
+        std::vector<Caller> completed;
+    };
+
+    Caller *openCaller();
+    void dispatch();
+    void start(Worker &worker);
+    void finished(Worker &worker, InferenceEngine::StatusCode status);
+
+    const int _batchSize;
+    const std::chrono::microseconds _deadline;
+    const int _featureVectorSize;
+    std::vector<Worker> _workers;
+    std::vector<Worker *> _idleWorkers;
+    std::vector<Item> _pending;     // in arrival order
+    const size_t _capacity;
+    QueueMeter _queue;
+    std::vector<std::unique_ptr<Caller>> _callers;
+    std::vector<Caller *> _freeCallers;
+    Stats _stats;
+    bool _stopping;
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    std::condition_variable _space;     // faces left _pending
+    std::thread _dispatcher;
+};
@@ -0,0 +1,304 @@
+# pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <inference_engine.hpp>
+
+#include <opencv2/opencv.hpp>
+
+#include "utility.hpp"
+#include "detectors.hpp"
+#include "feature_extractor.hpp"
+#include "bounded_queue.hpp"
+#include "classifier.hpp"
+#include "detection_batcher.hpp"
+#include "embedding_batcher.hpp"
+#include "face_arena.hpp"
+#include "frame_arena.hpp"
+#include "network_cache.hpp"
+#include "task_scheduler.hpp"
+
+class FramePipeline;
+struct StageResources;
+
+struct EngineConfig {
+    std::string faceDetectionModel = "models/face-detection-adas-0001.xml";
+    std::string facialLandmarksModel = "models/facial-landmarks-35-adas-0001.xml";
+    std::string featureExtractionModel = "models/Sphereface.xml";
+    std::string deviceName = "CPU";
+    double detectionThreshold = 0.5;
+    int maxFacesPerFrame = 16;
+    int inferRequests = 2;          // contexts serving concurrent recognize() calls
+    int detectionBatch = 1;         // frames of concurrent recognize() calls (up to inferRequests) detected in one inference
+    double detectionWindow = 2.0;   // milliseconds a detection batch waits to fill up
+    int detectionQueue = 0;         // frames waiting for a detection batch beyond which callers wait, 0 is inferRequests
+    int reservedInteractiveRequests = 0;    // of the inferRequests contexts, kept for interactive frames
+    int maxQueuedFrames = 0;        // frames waiting for a context beyond which the least urgent is shed, 0 is unbounded
+    int embeddingBatch = 1;         // aligned faces of all concurrent calls embedded in one inference
+    double embeddingDeadline = 5.0; // milliseconds a face waits for its embedding batch to fill up
+    int embeddingQueue = 0;         // faces waiting for an embedding batch beyond which callers wait,
+                                    // 0 is inferRequests * maxFacesPerFrame
+    int cpuThreads = 2;             // workers of the per-face CPU stages, 0 runs them on the caller
+                                    // and requires detectionBatch and embeddingBatch of 1
+    std::vector<int> cpuCores;      // cores of those workers, empty picks the ones left by inference
+    int inferenceThreads = 0;       // CPU plugin threads, 0 keeps the plugin default
+    bool bindInferenceThreads = true;   // bind them to the first cores and keep the rest for the CPU stages
+    std::shared_ptr<const Gallery> gallery;     // null selects the built-in gallery
+    std::shared_ptr<GalleryReplicas> galleryReplicas;   // placed copies of the gallery, null keeps it in place
+    HugePages hugePages = HugePages::None;  // backing of the gallery copy and the aligned face arenas
+    bool countTlbMisses = false;            // count data TLB misses of the gallery scans
+    bool parallelLoading = false;   // also load concurrently while serving (lazy loading, swaps), competing
+                                    // with the inference threads; before the first frame they always are
+    bool lazyLoading = false;       // load the networks on the first frame, only those its pipeline uses
+    int warmUpInferences = 1;       // synthetic inferences per infer request and batch size before the engine is ready
+    std::string networkCache;       // directory of compiled networks for later starts, empty compiles every start
+};
+
+// Networks of the engine. The values are their bits in a mask of models, e.g. the ones a
+// pipeline uses, and their numbers in the C API.
+enum class EngineModels : unsigned {
+    FaceDetection = 1,
+    FacialLandmarks = 2,
+    FeatureExtraction = 4
+};
+
+// Mask of models, modelMask() has none
+constexpr unsigned modelMask() {
+    return 0;
+}
+template <typename... Models>
+constexpr unsigned modelMask(EngineModels model, Models... models) {
+    return static_cast<unsigned>(model) | modelMask(models...);
+}
+
+enum class FramePriority {
+    Bulk,           // archive reprocessing, low priority cameras
+    Normal,
+    Interactive     // operator lookups, may use the reserved infer requests
+};
+
+// Scheduling of one frame. Frames waiting for a context are served by priority class,
+// then fresh frames before re-verifications, then earliest deadline first. A frame is
+// dropped before detection when its deadline can no longer be met.
+struct FrameOptions {
+    FramePriority priority = FramePriority::Normal;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    bool reverification = false;    // only re-verifies a track which is already identified
+};
+
+// Order in which waiting frames are served
+bool servedBefore(const FrameOptions &left, const FrameOptions &right);
+
+struct SchedulingStats {
+    unsigned long long recognized;
+    unsigned long long expired;                 // dropped as their deadline could not be met
+    unsigned long long shed;                    // dropped as the queue was full
+    unsigned long long reverificationsDropped;  // of the expired and shed ones
+};
+
+// Cold start of an engine, in milliseconds
+struct StartupStats {
+    double plugin;              // loading and configuring the plugin
+    double faceDetection;       // reading and compiling each network, 0 when not loaded
+    double facialLandmarks;
+    double featureExtraction;
+    double models;              // loading all of them, less than their sum when loaded in parallel
+    double warmUp;              // warm-up inferences on the infer requests
+    double firstFrame;          // from construction to the first recognized frame, 0 before it
+};
+
+struct RecognitionResult {
+    std::vector<FaceDetection::Result> detections;
+    std::vector<std::string> persons;
+    std::vector<cv::Mat> detectedFaces;     // ROIs of the source image
+    std::vector<cv::Mat> alignedFaces;      // views of alignedArena slots, empty when not aligned
+    AlignedFaceArena alignedArena;
+    double recognitionTime = 0.0;
+    bool dropped = false;                   // the frame was shed, nothing was recognized
+
+    void clear();
+};
+
+// Called once a frame of recognizeAsync() is complete, with the exception which failed it if any
+typedef std::function<void(std::exception_ptr)> RecognitionCallback;
+
+// Per infer request state: copies of the loaded networks sharing their executable
+// networks but owning their infer requests, pending inputs and results, plus the
+// buffers reused by every frame recognized in the context.
+struct InferContext {
+    FaceDetection faceDetector;
+    FacialLandmarksDetection facialLandmarksDetector;
+    FeatureExtraction featureExtractor;
+    Timer timer;
+    FrameArena arena;                   // per-frame temporaries, reset by every recognize()
+    std::vector<cv::Mat> faceBuffers;   // resized faces, one per landmarks batch slot
+
+    // The frame in flight, carried from one stage to the next
+    struct Frame {
+        const cv::Mat *image;
+        cv::Mat *detectedFacesImage;
+        cv::Mat *recognizedFacesImage;
+        RecognitionResult *recognition;
+        RecognitionCallback done;
+        InferenceEngine::StatusCode status;     // of the inference the next stage continues
+        FrameVector<const cv::Mat *> embeddedFaces;     // aligned faces which get an embedding
+        FrameVector<int> embeddedSlots;                 // and their detection indices
+        FrameVector<float> featureVectors;              // one row of featureVectorSize values per embedded face
+        size_t submittedFaces;      // embedded faces whose feature extraction was started
+
+        explicit Frame(FrameArena &arena);
+        // Rebinds the vectors after the arena was reset
+        void reset(FrameArena &arena);
+    } frame;
+    FramePipeline *pipeline;    // bound to the context's requests, frames of the context run through it
+
+    InferContext(const FaceDetection &faceDetector,
+                 const FacialLandmarksDetection &facialLandmarksDetector,
+                 const FeatureExtraction &featureExtractor);
+};
+
+// Owns the plugin and the loaded networks so that they are read and compiled once
+// per process instead of once per recognizeFaces() call.
+// recognize() is reentrant: concurrent calls are spread over config.inferRequests
+// contexts and wait only when all of them are busy.
+class FaceRecognitionEngine {
+public:
+    explicit FaceRecognitionEngine(const EngineConfig &config = EngineConfig());
+    ~FaceRecognitionEngine();
+
+    // detectedFacesImage and recognizedFacesImage are allocated when empty,
+    // otherwise they shall have the size and type of image.
+    void recognize(const cv::Mat &image, cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                   RecognitionResult &recognition);
+    // Sets recognition.dropped instead when the frame is shed
+    void recognize(const cv::Mat &image, cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                   RecognitionResult &recognition, const FrameOptions &options);
+    // Returns once the frame has a context and its detection is started; the stages then
+    // continue from the completion of each inference on the CPU scheduler and done is
+    // called on the thread finishing the frame. The arguments shall live until then.
+    // Only waiting for a free context blocks the caller. done shall not throw.
+    void recognizeAsync(const cv::Mat &image, cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                        RecognitionResult &recognition, const FrameOptions &options, RecognitionCallback done);
+
+    // Replaces the stages run for every frame by StagePipeline<Stages...>, see stages.hpp,
+    // loading the networks they use if needed. The default one is picked from the enabled
+    // models. Defined in stage_graph.hpp, to be called while no frame is in flight.
+    template <typename... Stages>
+    void assemble();
+
+    // Replaces the network of model by the one of modelPath without stopping: the new
+    // network is loaded and warmed up next to the current one, then new frames go to it
+    // while the frames in flight finish on the old one. Returns once they are done, callers
+    // run it off the serving threads; the old network is freed by the next swap. A feature
+    // extraction network only comes with a gallery enrolled with it, see enroll() and
+    // Gallery::enrolledWith(); other networks keep the gallery. Throws and keeps the current
+    // network on failure.
+    void swapModel(EngineModels model, const std::string &modelPath,
+                   std::shared_ptr<const Gallery> gallery = nullptr);
+    // Gallery of faces, rowLabels indexing labels for each of them, embedded by the current
+    // feature extraction network and stamped with its modelHash(), so that it can be saved
+    // and swapped in with that network. Faces are best the aligned ones of a recognition
+    // (RecognitionResult::alignedFaces). Runs on its own request next to the frames.
+    std::shared_ptr<const Gallery> enroll(const std::vector<std::string> &labels, const std::vector<int> &rowLabels,
+                                          const std::vector<cv::Mat> &faces);
+
+    // As created, the model paths of swapped networks are given by modelPath()
+    const EngineConfig &config() const;
+    // Model path of the network frames are recognized with now
+    std::string modelPath(EngineModels model) const;
+    // Replaced by the next swap of the feature extraction network
+    std::shared_ptr<GalleryReplicas> galleryReplicas() const;
+    // Batches and frames detected so far, zeros when detection is not batched
+    DetectionBatcher::Stats detectionStats() const;
+    // Embedding batches and faces so far, zeros when embeddings are not batched
+    EmbeddingBatcher::Stats embeddingStats() const;
+    SchedulingStats schedulingStats() const;
+    // Queues between the stages in pipeline order: the frames waiting for a context
+    // ("admission", shedding beyond maxQueuedFrames), then the frames and faces waiting for
+    // a batch ("detection", "feature_extraction") when batched
+    std::vector<QueueStats> queueStats() const;
+    StartupStats startupStats() const;
+
+private:
+    FaceRecognitionEngine(const FaceRecognitionEngine &) = delete;
+    FaceRecognitionEngine &operator=(const FaceRecognitionEngine &) = delete;
+
+    typedef std::chrono::steady_clock Clock;
+
+    // A frame waiting for a context, on the stack of its caller
+    struct Waiter {
+        const FrameOptions &options;
+        InferContext *context;
+        bool shed;
+        std::condition_variable granted;
+
+        explicit Waiter(const FrameOptions &options) : options(options), context(nullptr), shed(false) {}
+        bool before(const Waiter &other) const { return servedBefore(options, other.options); }
+    };
+
+    // Null when the frame is dropped
+    InferContext *acquireContext(const FrameOptions &options);
+    void releaseContext(InferContext &context);
+    // Whether a frame of options may take an idle context now, under _mutex
+    bool mayUseIdleContext(const FrameOptions &options) const;
+    // Gives context to the first waiter or makes it idle, under _mutex
+    void handOver(InferContext &context);
+    // Counts a dropped frame, under _mutex
+    void dropFrame(const FrameOptions &options, unsigned long long &counter);
+
+    typedef std::function<std::unique_ptr<FramePipeline>(const StageResources &)> PipelineFactory;
+    // The networks and gallery frames run on, with the batchers, stages and contexts built
+    // on them. Frames run from start to end on one set; a model swap builds the next one.
+    struct ModelSet;
+
+    // The stage resources of set, on its classifier and batchers
+    void createResources(ModelSet &set);
+    // Reads and compiles the enabled networks of models which set has not loaded yet,
+    // recreates its contexts and the batchers of the new networks and warms them up.
+    // Returns the time taken, the pipeline of set shall be built again after.
+    StartupStats loadModels(ModelSet &set, unsigned models);
+    // Warms up the requests of the contexts of set, and of the batchers of models
+    double warmUp(ModelSet &set, unsigned models);
+    // Builds the pipeline of set and binds its contexts to it
+    void buildPipeline(ModelSet &set);
+    // The pipeline of the enabled models, unless one was assembled already
+    void assembleDefault();
+    void setPipeline(unsigned models, PipelineFactory factory);
+    // As assemble() and setPipeline(), under _loadMutex
+    template <typename... Stages>
+    void assembleLocked();
+    void setPipelineLocked(unsigned models, PipelineFactory factory);
+    // Releases the context and calls done
+    void finishFrame(InferContext &context, std::exception_ptr error);
+
+    Clock::time_point _created;     // the time to first frame counts from there
+    EngineConfig _config;
+    InferenceEngine::InferencePlugin _plugin;
+    std::unique_ptr<NetworkCache> _networkCache;
+    std::unique_ptr<TaskScheduler> _scheduler;
+    std::unique_ptr<ModelSet> _models;      // new frames start on it
+    std::unique_ptr<ModelSet> _retired;     // swapped out, with frames in flight
+    std::unique_ptr<ModelSet> _released;    // last drained one, freed by the next swap or the engine
+    PipelineFactory _pipelineFactory;
+    unsigned _pipelineModels;       // modelMask() of the pipeline
+    std::atomic<bool> _assembled;   // the pipeline is set, lazy loading assembles it on the first frame
+    std::atomic<bool> _serving;     // a frame was started, loads compete with its inferences
+    std::mutex _loadMutex;          // serializes assembling and swapping
+    StartupStats _startupStats;
+
+    std::vector<InferContext *> _idleContexts;      // of _models
+    std::condition_variable _drained;   // the last frame of _retired is done
+    std::vector<Waiter *> _waiters;
+    QueueMeter _admission;          // of _waiters
+    SchedulingStats _schedulingStats;
+    double _expectedTime;           // smoothed milliseconds of a recognition
+    mutable std::mutex _mutex;
+};
@@ -0,0 +1,47 @@
+# pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "node_memory.hpp"
+
+struct AlignedFaceRecord {
+    uint64_t offset;    // from the arena start, in bytes
+    uint32_t rows;      // 0 when the face could not be aligned
+    uint32_t cols;
+};
+
+// Aligned faces of one frame stored back to back in fixed size slots of a single
+// preallocated buffer, so that clients can take them as one (count, rows, cols, 3) view.
+class AlignedFaceArena {
+public:
+    AlignedFaceArena();
+
+    // Keeps the current buffer when capacity, face size and pages are unchanged.
+    void reserve(int capacity, const cv::Size &faceSize, HugePages hugePages = HugePages::None);
+    void clear();
+
+    // Returns a view of the next free slot, or an empty Mat when the arena is full.
+    cv::Mat allocate();
+    // Marks an allocated slot as holding no face.
+    void reject(int index);
+
+    int capacity() const;
+    int size() const;
+    cv::Size faceSize() const;
+    size_t slotBytes() const;
+    size_t usedBytes() const;
+
+    const unsigned char *data() const;
+    const cv::Mat &storage() const;
+    const std::vector<AlignedFaceRecord> &table() const;
+
+private:
+    int _capacity;
+    cv::Size _faceSize;
+    HugePages _hugePages;
+    cv::Mat _storage;
+    std::vector<AlignedFaceRecord> _table;
+};
@@ -24,6 +24,8 @@
 
 #include <opencv2/opencv.hpp>
 
+class MappedFile;
+
 struct FeatureExtraction {
     InferenceEngine::ExecutableNetwork net;
     InferenceEngine::InferencePlugin * plugin;
@@ -36,6 +38,10 @@ struct FeatureExtraction {
     const bool isAsync;
     mutable bool enablingChecked;
     mutable bool _enabled;
+    // As BaseDetection::completion
+    std::function<void(InferenceEngine::StatusCode)> completion;
+    InferenceEngine::InferRequest *callbackRequest;
+    std::shared_ptr<const MappedFile> weights;  // as BaseDetection::weights
 
     FeatureExtraction(const std::string &pathToModel,
                   const std::string &deviceForInference,
@@ -46,19 +52,24 @@ struct FeatureExtraction {
     bool enabled() const;
 
     InferenceEngine::ExecutableNetwork* operator ->();
-    virtual InferenceEngine::CNNNetwork read();
+    virtual InferenceEngine::CNNNetwork read(bool withWeights = true);
+    // Fills the next batch slot, at most maxBatch faces per request
     void enqueue(const cv::Mat &frame);
     virtual void submitRequest();
     virtual void wait();
+    // One row of featureVectorSize values per face of the request
     void fetchResults();
     void printPerformanceCounts();
 
     std::string input;
     std::string output;
     int enquedFrames;
+    int submittedFrames;
     float width;
     float height;
+    cv::Size inputSize;
     bool resultsFetched;
+    cv::Mat resizedFrame;       // reused by enqueue()
     int featureVectorSize;
     std::vector<float> results;
 };
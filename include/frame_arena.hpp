@@ -0,0 +1,60 @@
+# pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for the temporaries of one frame. reset() at the start of a frame makes
+// the whole arena available again; blocks are only allocated while the arena is still
+// growing to the working set, after which a frame allocates nothing from the heap.
+class FrameArena {
+public:
+    explicit FrameArena(size_t blockSize = 64 * 1024);
+
+    void *allocate(size_t bytes, size_t alignment);
+    void reset();
+
+    size_t used() const;
+    size_t capacity() const;
+
+private:
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    size_t _blockSize;
+    std::vector<Block> _blocks;
+    size_t _block;
+    size_t _offset;
+    size_t _used;
+};
+
+// Standard allocator over a FrameArena. Deallocation is a no-op, memory is reclaimed
+// by the next FrameArena::reset().
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    FrameArena *arena;
+
+    explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) {
+        return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
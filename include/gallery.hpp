@@ -0,0 +1,88 @@
+# pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "node_memory.hpp"
+
+// Gallery file layout, also used for the in-memory built-in gallery:
+//
+//   GalleryHeader | label names[labelCount] | row labels[count] | embeddings[count][dimension]
+//
+// Label names are GALLERY_LABEL_SIZE byte zero padded strings, row labels are uint32
+// indices into them and embeddings are float32. Every region starts on a 64 byte boundary.
+
+const uint32_t GALLERY_MAGIC = 0x4C4C4147; // "GALL"
+const uint32_t GALLERY_VERSION = 1;
+const size_t GALLERY_LABEL_SIZE = 32;
+
+struct GalleryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t count;
+    uint32_t labelCount;
+    uint32_t reserved0;
+    uint64_t labelsOffset;      // from the gallery start
+    uint64_t rowLabelsOffset;
+    uint64_t embeddingsOffset;
+    uint64_t size;
+    uint64_t embeddingModel;    // modelHash() of the network the embeddings come from, 0 when unknown
+};
+
+// Immutable set of labelled embeddings scanned by Classification. A gallery is shared
+// by every engine (and shard) it is given to; a mapped gallery file is mapped read-only,
+// so its pages are also shared with other processes using the same file.
+class Gallery {
+public:
+    ~Gallery();
+
+    // Gallery of tmp_database.hpp, built once per process.
+    static std::shared_ptr<const Gallery> builtin();
+    static std::shared_ptr<const Gallery> map(const std::string &path);
+    // Labels are at most GALLERY_LABEL_SIZE - 1 characters, longer ones are refused
+    static std::shared_ptr<const Gallery> build(const std::vector<std::string> &labels,
+                                                const std::vector<int> &rowLabels,
+                                                const std::vector<std::vector<float>> &embeddings,
+                                                uint64_t embeddingModel = 0);
+    // Copy placed on a NUMA node (see allocateNodeMemory), optionally on huge pages
+    static std::shared_ptr<const Gallery> copy(const Gallery &source, int node,
+                                               HugePages hugePages = HugePages::None);
+
+    void save(const std::string &path) const;
+
+    int dimension() const;
+    int size() const;
+    int labelCount() const;
+    uint64_t embeddingModel() const;
+    // Whether the embeddings come from the network of featureExtractionModel, as stamped
+    // by FaceRecognitionEngine::enroll(); a gallery of unknown embeddings is of none
+    bool enrolledWith(const std::string &featureExtractionModel) const;
+
+    const float *embeddings() const;
+    const float *embedding(int row) const;
+    std::string label(int index) const;
+    // Zero padded label of GALLERY_LABEL_SIZE bytes, not necessarily terminated
+    const char *labelData(int index) const;
+    int rowLabel(int row) const;
+
+    const GalleryHeader &header() const;
+    const unsigned char *data() const;
+    HugePages hugePages() const;
+
+private:
+    Gallery();
+    Gallery(const Gallery &) = delete;
+    Gallery &operator=(const Gallery &) = delete;
+
+    void validate() const;
+
+    const unsigned char *_base;
+    size_t _size;
+    bool _mapped;
+    bool _nodeMemory;
+    HugePages _hugePages;
+    std::vector<uint64_t> _owned;
+};
@@ -0,0 +1,67 @@
+# pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gallery.hpp"
+
+enum class GalleryPlacement {
+    Local,          // a single copy, pages stay where they were first touched
+    Interleaved,    // a single copy with pages interleaved across the nodes
+    Replicated      // one copy per node, scans read the copy of their node
+};
+
+// Places a gallery on the NUMA nodes and routes scans to the copy local to the calling
+// thread. Scan traffic is counted per node of the scanning threads, so that a remote
+// bound scan shows up as a node with a low bandwidth. With huge pages every placement,
+// Local included, scans a copy on 2 MB pages.
+class GalleryReplicas {
+public:
+    struct NodeBandwidth {
+        uint64_t scans;
+        uint64_t bytes;
+        double milliseconds;
+        uint64_t tlbMisses;     // data TLB load misses, 0 unless counted
+
+        double gigabytesPerSecond() const;
+    };
+
+    GalleryReplicas(std::shared_ptr<const Gallery> gallery, GalleryPlacement placement,
+                    HugePages hugePages = HugePages::None);
+
+    // Gallery to scan from the calling thread and the node the scan is accounted to
+    const Gallery &local(int &node) const;
+    void recordScan(int node, uint64_t bytes, double milliseconds, uint64_t tlbMisses = 0);
+
+    // Scans read the TLB miss counter of their thread when enabled
+    void countTlbMisses(bool enabled);
+    bool countsTlbMisses() const;
+
+    GalleryPlacement placement() const;
+    HugePages hugePages() const;
+    int nodes() const;
+    const Gallery &replica(int node) const;
+    std::vector<NodeBandwidth> bandwidth() const;
+    void resetBandwidth();
+
+private:
+    GalleryReplicas(const GalleryReplicas &) = delete;
+    GalleryReplicas &operator=(const GalleryReplicas &) = delete;
+
+    struct Counters {
+        std::atomic<uint64_t> scans;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> nanoseconds;
+        std::atomic<uint64_t> tlbMisses;
+
+        Counters() : scans(0), bytes(0), nanoseconds(0), tlbMisses(0) {}
+    };
+
+    GalleryPlacement _placement;
+    HugePages _hugePages;
+    std::atomic<bool> _countTlbMisses;
+    std::vector<std::shared_ptr<const Gallery>> _replicas;
+    std::vector<std::unique_ptr<Counters>> _counters;
+};
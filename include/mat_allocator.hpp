@@ -0,0 +1,10 @@
+# pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include "node_memory.hpp"
+
+// cv::Mat allocator placing buffers on huge pages (see allocateNodeMemory). Mats keep their
+// reference counting, so views of such buffers stay valid as with the default allocator.
+// Returns null, the default allocator, for HugePages::None.
+cv::MatAllocator *hugePageMatAllocator(HugePages hugePages);
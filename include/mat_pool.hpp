@@ -0,0 +1,27 @@
+# pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// Recycles cv::Mat buffers handed out to consumers which release them at an unknown
+// time (e.g. Python objects). A pooled buffer is handed out again once every Mat sharing
+// it, other than the pool's own reference, has been released.
+class MatPool {
+public:
+    // Buffers above maxBuffers in use are allocated without being pooled
+    explicit MatPool(size_t maxBuffers = 16);
+
+    cv::Mat acquire(int rows, int cols, int type);
+
+    size_t size() const;
+
+private:
+    MatPool(const MatPool &) = delete;
+    MatPool &operator=(const MatPool &) = delete;
+
+    size_t _maxBuffers;
+    mutable std::mutex _mutex;
+    std::vector<cv::Mat> _buffers;
+};
@@ -0,0 +1,66 @@
+# pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <inference_engine.hpp>
+
+// Read-only view of a whole file mapped copy-on-write: its pages come from the page
+// cache, shared with other processes reading the same file, and are not copied to the
+// heap unless written.
+class MappedFile {
+public:
+    ~MappedFile();
+
+    static std::shared_ptr<const MappedFile> map(const std::string &path);
+
+    const uint8_t *data() const { return _base; }
+    size_t size() const { return _size; }
+
+private:
+    MappedFile() : _base(nullptr), _size(0) {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    uint8_t *_base;
+    size_t _size;
+};
+
+// Sets the weights of reader to the mapped .bin file, which shall live as long as the
+// network read from it
+std::shared_ptr<const MappedFile> mapWeights(InferenceEngine::CNNNetReader &reader, const std::string &binFileName);
+
+// Hash of the contents of the .xml and .bin files of the network of modelPath, which tells
+// its versions apart wherever they are stored, e.g. for the galleries enrolled with it
+uint64_t modelHash(const std::string &modelPath);
+
+// Directory of executable networks exported by the plugin, so that later processes
+// import the compiled network instead of reading the weights and compiling the IR.
+// A network is keyed by the path, device, inode, size and modification time of its .xml
+// and .bin files, its batch and load config, the device, version and config of the plugin,
+// and the cache format version of the library. Files are only stat'ed, never read, to
+// build the key; a changed model or plugin is compiled again and its export sits next to
+// the stale ones.
+// The methods may be called concurrently, for the networks loaded in parallel.
+class NetworkCache {
+public:
+    NetworkCache(const std::string &directory, InferenceEngine::InferencePlugin &plugin, const std::string &deviceName,
+                 const std::map<std::string, std::string> &pluginConfig);
+
+    // File of the network of modelPath compiled with batch and config
+    std::string path(const std::string &modelPath, int batch, const std::map<std::string, std::string> &config) const;
+    // False when the file does not exist or the plugin cannot import it
+    bool import(const std::string &path, const std::map<std::string, std::string> &config,
+                InferenceEngine::ExecutableNetwork &network) const;
+    // Exports network to path, replacing the file atomically. A plugin which cannot
+    // export only gets a warning.
+    void store(InferenceEngine::ExecutableNetwork &network, const std::string &path) const;
+
+private:
+    const std::string _directory;
+    InferenceEngine::InferencePlugin &_plugin;
+    uint64_t _pluginHash;       // of the device, version and config of the plugin
+};
@@ -0,0 +1,26 @@
+# pragma once
+
+#include <cstddef>
+
+const int INTERLEAVED_NODES = -1;
+const int ANY_NODE = -2;
+
+enum class HugePages {
+    None,
+    Transparent,    // 2 MB transparent huge pages requested with madvise
+    Explicit        // MAP_HUGETLB from the reserved pool, transparent ones when it is empty
+};
+
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Page aligned anonymous memory whose pages are placed on the given NUMA node, interleaved
+// across all nodes for INTERLEAVED_NODES, or left to the default policy for ANY_NODE.
+// Placement and huge pages are best effort: without kernel support the memory is allocated
+// with regular pages and the default policy. Returns null when the memory cannot be allocated.
+void *allocateNodeMemory(size_t size, int node, HugePages hugePages = HugePages::None);
+// size and hugePages shall be the ones of the allocation
+void freeNodeMemory(void *memory, size_t size, HugePages hugePages = HugePages::None);
+
+int nodeCount();
+// NUMA node of the core the calling thread is running on
+int currentNode();
@@ -0,0 +1,21 @@
+# pragma once
+
+#include <cstdint>
+
+// Data TLB load misses of the calling thread, counted by the kernel perf events.
+// available() is false when perf events are not permitted (perf_event_paranoid) or
+// not supported, in which case read() returns 0.
+class TlbMissCounter {
+public:
+    TlbMissCounter();
+    ~TlbMissCounter();
+
+    bool available() const;
+    uint64_t read() const;
+
+private:
+    TlbMissCounter(const TlbMissCounter &) = delete;
+    TlbMissCounter &operator=(const TlbMissCounter &) = delete;
+
+    int _fd;
+};
@@ -0,0 +1,54 @@
+# pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "engine.hpp"
+
+struct ShardedEngineConfig {
+    EngineConfig engine;        // per shard, the CPU stage and inference threads are sized to the shard cores
+    int shards = 0;             // 0 makes one shard per NUMA node
+    std::string galleryPath;    // gallery file mapped once for all shards, empty keeps engine.gallery
+    GalleryPlacement galleryPlacement = GalleryPlacement::Replicated;
+};
+
+// Thread-per-core serving mode. The available cores are split into shards in NUMA node
+// order, so that a shard does not span two nodes when the shard count allows it. Every
+// shard runs its own engine (infer requests, task scheduler, CPU stages) from serving
+// threads pinned to its cores; the engine is created on one of them, so first-touch puts
+// its buffers on the shard's node. Streams are assigned to shards by hash and the gallery
+// is shared read-only by all of them, by default with one replica per node.
+class ShardedEngine {
+public:
+    explicit ShardedEngine(const ShardedEngineConfig &config);
+    ~ShardedEngine();
+
+    // Frames of one stream are always recognized by the same shard.
+    int shardOf(const std::string &stream) const;
+    // Queued frames of a shard are served in the order of servedBefore()
+    void recognize(const std::string &stream, const cv::Mat &image, cv::Mat &detectedFacesImage,
+                   cv::Mat &recognizedFacesImage, RecognitionResult &recognition,
+                   const FrameOptions &options = FrameOptions());
+
+    int size() const;
+    const std::vector<int> &cores(int shard) const;
+    int node(int shard) const;
+    std::shared_ptr<GalleryReplicas> galleryReplicas() const;
+    // Summed over the shards
+    SchedulingStats schedulingStats() const;
+
+private:
+    ShardedEngine(const ShardedEngine &) = delete;
+    ShardedEngine &operator=(const ShardedEngine &) = delete;
+
+    struct Shard;
+
+    void serve(Shard &shard, int thread);
+    void stop();
+
+    std::shared_ptr<GalleryReplicas> _galleryReplicas;
+    std::vector<std::unique_ptr<Shard>> _shards;
+};
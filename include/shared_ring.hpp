@@ -0,0 +1,100 @@
+# pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// Layout of the POSIX shared memory segment exchanged with the Python client
+// (see SharedRing in face_recognition_adapter.py, which mirrors these structs):
+//
+//   SharedRingHeader | frame slot 0 .. N-1 | result slot 0 .. N-1
+//
+// Frame slot:  maxRows * maxCols * 3 bytes, BGR, written in place by the client.
+// Result slot: SharedResultHeader | SharedFaceRecord[maxFaces] | detection image |
+//              recognition image | aligned faces area.
+// All offsets are in bytes and every region starts on a 64 byte boundary. The segment is
+// writable by the client, so the engine only writes the headers and never reads them back.
+
+const uint32_t SHARED_RING_MAGIC = 0x52535246; // "FRSR"
+const uint32_t SHARED_RING_VERSION = 1;
+const size_t SHARED_RING_LABEL_SIZE = 32;
+
+struct SharedRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t maxRows;
+    uint32_t maxCols;
+    uint32_t maxFaces;
+    uint64_t frameSlotSize;
+    uint64_t resultSlotSize;
+    uint64_t framesOffset;      // from the segment start
+    uint64_t resultsOffset;     // from the segment start
+    uint64_t reserved;
+};
+
+struct SharedResultHeader {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t faceCount;
+    uint32_t truncated;         // aligned faces which did not fit into the slot
+    double recognitionTime;
+    uint64_t detectionOffset;   // from the result slot start
+    uint64_t recognitionOffset;
+    uint64_t alignedOffset;
+    uint64_t alignedCapacity;
+    uint64_t reserved;
+};
+
+struct SharedFaceRecord {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    uint32_t alignedRows;
+    uint32_t alignedCols;
+    uint64_t alignedOffset;     // from the aligned faces area start
+    char label[SHARED_RING_LABEL_SIZE];
+};
+
+class SharedRing {
+public:
+    SharedRing();
+    ~SharedRing();
+
+    void create(const std::string &name, int slotCount, int maxRows, int maxCols, int maxFaces);
+    void destroy();
+    bool isOpen() const;
+
+    int acquire();
+    void release(int slot);
+
+    cv::Mat frame(int slot, int rows, int cols);
+    cv::Mat detectionImage(int slot, int rows, int cols);
+    cv::Mat recognitionImage(int slot, int rows, int cols);
+    SharedResultHeader &result(int slot);
+    SharedFaceRecord *faces(int slot);
+    unsigned char *alignedFaces(int slot);
+    size_t alignedCapacity() const;
+
+    // The layout the ring was created with, not the header in the segment
+    const SharedRingHeader &header() const;
+
+private:
+    SharedRing(const SharedRing &) = delete;
+    SharedRing &operator=(const SharedRing &) = delete;
+
+    unsigned char *resultSlot(int slot);
+    void checkSlot(int slot, int rows, int cols) const;
+
+    std::string _name;
+    unsigned char *_base;
+    size_t _size;
+    SharedRingHeader _layout;
+    SharedResultHeader _resultLayout;   // offsets of every result slot
+    std::mutex _mutex;
+    std::vector<bool> _busy;
+};
@@ -0,0 +1,156 @@
+# pragma once
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include <inference_engine.hpp>
+
+#include "engine.hpp"
+
+// What the stages of an engine share: its configuration, CPU scheduler, and the classifier
+// and batchers (null when not batched) of the models the frame runs on, and how a frame
+// is finished.
+struct StageResources {
+    const EngineConfig &config;
+    TaskScheduler &scheduler;
+    const Classification &classifier;
+    DetectionBatcher *detectionBatcher;
+    EmbeddingBatcher *embeddingBatcher;
+    // Releases the context and reports the frame, error is null on success
+    std::function<void(InferContext &context, std::exception_ptr error)> finish;
+};
+
+// The stages the engine runs for every frame. The engine holds one pipeline per set of
+// models and calls it once per frame; everything below start() is resolved at compile time.
+class FramePipeline {
+public:
+    virtual ~FramePipeline() {}
+    // Installs the completions of the context's infer requests
+    virtual void bind(InferContext &context) = 0;
+    // Runs the frame set up in context.frame through the stages
+    virtual void start(InferContext &context) = 0;
+};
+
+// Pipeline of the stage types Stages..., run in order. A stage type S provides
+//
+//   explicit S(const StageResources &resources);
+//   static const bool async;           // whether it runs an inference
+//   static const unsigned models;      // modelMask() of the networks it uses, loaded on assembly
+//   bool run(InferContext &context);   // true when it started an inference
+//
+// and when async,
+//
+//   static void bind(InferContext &context, std::function<void(InferenceEngine::StatusCode)> completion);
+//   bool resume(InferContext &context);    // after the completion, true when it started another one
+//
+// A stage which started an inference is resumed from the CPU scheduler once it completes,
+// the next stage runs when it returns false. Stages are called directly and inline into
+// the pipeline, so a deployment leaving a stage out does not test for it on every face.
+// modelMask() of the networks used by any of Stages...
+template <typename... Stages>
+struct StageModels;
+template <>
+struct StageModels<> {
+    static const unsigned value = modelMask();
+};
+template <typename Stage, typename... Stages>
+struct StageModels<Stage, Stages...> {
+    static const unsigned value = Stage::models | StageModels<Stages...>::value;
+};
+
+template <typename... Stages>
+class StagePipeline : public FramePipeline {
+public:
+    explicit StagePipeline(const StageResources &resources) : _resources(resources), _stages(Stages(resources)...) {}
+
+    void bind(InferContext &context) override { bindFrom<0>(context); }
+    void start(InferContext &context) override { runFrom<0>(context); }
+
+private:
+    static const size_t COUNT = sizeof...(Stages);
+
+    template <size_t I>
+    using StageAt = typename std::tuple_element<I, std::tuple<Stages...>>::type;
+    template <size_t I>
+    using IsAsync = std::integral_constant<bool, StageAt<I>::async>;
+
+    template <size_t I>
+    typename std::enable_if<(I < COUNT)>::type bindFrom(InferContext &context) {
+        bindStage<I>(context, IsAsync<I>());
+        bindFrom<I + 1>(context);
+    }
+    template <size_t I>
+    typename std::enable_if<(I == COUNT)>::type bindFrom(InferContext &) {}
+
+    // The completion runs on an inference thread and hands the stage over to the scheduler;
+    // both closures hold two pointers and do not allocate.
+    template <size_t I>
+    void bindStage(InferContext &context, std::true_type) {
+        InferContext *pending = &context;
+        StageAt<I>::bind(context, [this, pending](InferenceEngine::StatusCode status) {
+            pending->frame.status = status;
+            _resources.scheduler.submit([this, pending] { resumeStage<I>(*pending, IsAsync<I>()); });
+        });
+    }
+    template <size_t I>
+    void bindStage(InferContext &, std::false_type) {}
+
+    // Runs stages from I on until one of them started an inference
+    template <size_t I>
+    typename std::enable_if<(I < COUNT)>::type runFrom(InferContext &context) {
+        bool started = false;
+        try {
+            started = std::get<I>(_stages).run(context);
+        }
+        catch (...) {
+            _resources.finish(context, std::current_exception());
+            return;
+        }
+        if (!started) runFrom<I + 1>(context);
+    }
+    template <size_t I>
+    typename std::enable_if<(I == COUNT)>::type runFrom(InferContext &context) {
+        _resources.finish(context, nullptr);
+    }
+
+    template <size_t I>
+    void resumeStage(InferContext &context, std::true_type) {
+        bool started = false;
+        try {
+            if (context.frame.status != InferenceEngine::StatusCode::OK) {
+                throw std::runtime_error("Inference failed with status " + std::to_string(context.frame.status));
+            }
+            started = std::get<I>(_stages).resume(context);
+        }
+        catch (...) {
+            _resources.finish(context, std::current_exception());
+            return;
+        }
+        if (!started) runFrom<I + 1>(context);
+    }
+    template <size_t I>
+    void resumeStage(InferContext &, std::false_type) {}
+
+    const StageResources &_resources;
+    std::tuple<Stages...> _stages;
+};
+
+template <typename... Stages>
+void FaceRecognitionEngine::assemble() {
+    setPipeline(StageModels<Stages...>::value, [](const StageResources &resources) {
+        return std::unique_ptr<FramePipeline>(new StagePipeline<Stages...>(resources));
+    });
+}
+
+template <typename... Stages>
+void FaceRecognitionEngine::assembleLocked() {
+    setPipelineLocked(StageModels<Stages...>::value, [](const StageResources &resources) {
+        return std::unique_ptr<FramePipeline>(new StagePipeline<Stages...>(resources));
+    });
+}
@@ -0,0 +1,155 @@
+# pragma once
+
+#include <algorithm>
+#include <functional>
+
+#include <inference_engine.hpp>
+
+#include "stage_graph.hpp"
+
+// Stage components of the recognition pipeline, see StagePipeline. The default one is
+//
+//   DetectFaces, EstimateLandmarks, AlignFaces, ExtractFeatures, ClassifyFaces, DrawResults
+//
+// and a deployment may assemble another one, e.g. with a QualityGate after DetectFaces,
+// or with CropFaces instead of EstimateLandmarks and AlignFaces to skip the landmarks.
+
+// Detects the faces of the frame into recognition.detections, in a detection batch
+// shared with concurrent frames when batching is configured
+class DetectFaces {
+public:
+    static const bool async = true;
+    static const unsigned models = modelMask(EngineModels::FaceDetection);
+
+    explicit DetectFaces(const StageResources &resources) : _resources(resources) {}
+    static void bind(InferContext &context, std::function<void(InferenceEngine::StatusCode)> completion) {
+        context.faceDetector.completion = std::move(completion);
+    }
+    bool run(InferContext &context);
+    bool resume(InferContext &context);
+
+private:
+    const StageResources &_resources;
+};
+
+// Drops the detections failing Predicate, a default constructible
+// bool(const FaceDetection::Result &) functor, before any per-face work
+template <typename Predicate>
+class QualityGate {
+public:
+    static const bool async = false;
+    static const unsigned models = modelMask();
+
+    explicit QualityGate(const StageResources &) {}
+    bool run(InferContext &context) {
+        auto &detections = context.frame.recognition->detections;
+        detections.erase(std::remove_if(detections.begin(), detections.end(),
+                                        [this](const FaceDetection::Result &face) { return !_accept(face); }),
+                         detections.end());
+        return false;
+    }
+
+private:
+    Predicate _accept;
+};
+
+// Faces of at least Pixels width and height
+template <int Pixels>
+struct MinimumFaceSize {
+    bool operator()(const FaceDetection::Result &face) const {
+        return face.location.width >= Pixels && face.location.height >= Pixels;
+    }
+};
+
+// Crops the detected faces into recognition.detectedFaces and estimates their landmarks,
+// one batch slot per face
+class EstimateLandmarks {
+public:
+    static const bool async = true;
+    static const unsigned models = modelMask(EngineModels::FacialLandmarks);
+
+    explicit EstimateLandmarks(const StageResources &resources) : _resources(resources) {}
+    static void bind(InferContext &context, std::function<void(InferenceEngine::StatusCode)> completion) {
+        context.facialLandmarksDetector.completion = std::move(completion);
+    }
+    bool run(InferContext &context);
+    bool resume(InferContext &context);
+
+private:
+    const StageResources &_resources;
+};
+
+// Aligns the faces on their eyes into recognition.alignedFaces, queueing the aligned
+// ones for their embedding
+class AlignFaces {
+public:
+    static const bool async = false;
+    static const unsigned models = modelMask(EngineModels::FacialLandmarks);
+
+    explicit AlignFaces(const StageResources &resources) : _resources(resources) {}
+    bool run(InferContext &context);
+
+private:
+    const StageResources &_resources;
+};
+
+// Instead of EstimateLandmarks and AlignFaces: resizes the detected faces to the
+// embedding input without aligning them
+class CropFaces {
+public:
+    static const bool async = false;
+    static const unsigned models = modelMask();
+
+    explicit CropFaces(const StageResources &resources) : _resources(resources) {}
+    bool run(InferContext &context);
+
+private:
+    const StageResources &_resources;
+};
+
+// Embeds the queued faces, in chunks of the extractor batch or in embedding batches
+// shared with concurrent frames when batching is configured
+class ExtractFeatures {
+public:
+    static const bool async = true;
+    static const unsigned models = modelMask(EngineModels::FeatureExtraction);
+
+    explicit ExtractFeatures(const StageResources &resources) : _resources(resources) {}
+    static void bind(InferContext &context, std::function<void(InferenceEngine::StatusCode)> completion) {
+        context.featureExtractor.completion = std::move(completion);
+    }
+    bool run(InferContext &context);
+    bool resume(InferContext &context);
+
+private:
+    // Starts the next chunk, false when all faces are embedded
+    bool submitChunk(InferContext &context);
+
+    const StageResources &_resources;
+};
+
+// Labels the embedded faces from the gallery into recognition.persons
+class ClassifyFaces {
+public:
+    static const bool async = false;
+    static const unsigned models = modelMask(EngineModels::FeatureExtraction);
+
+    explicit ClassifyFaces(const StageResources &resources) : _resources(resources) {}
+    bool run(InferContext &context);
+
+private:
+    const StageResources &_resources;
+};
+
+// Draws the detections, and the labels on the recognized faces image
+class DrawResults {
+public:
+    static const bool async = false;
+    static const unsigned models = modelMask();
+
+    explicit DrawResults(const StageResources &resources) : _resources(resources) {}
+    bool run(InferContext &context);
+
+private:
+    const StageResources &_resources;
+};
@@ -0,0 +1,77 @@
+# pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for the CPU side of the pipeline (per-face cropping, alignment,
+// blob packing, classification, drawing). Every worker owns a deque: it pops its own
+// tasks LIFO and steals FIFO from the others when it runs dry. Threads waiting in
+// parallelFor() execute pending tasks instead of blocking, so nested use is safe.
+// Once the deques have grown to their working size, parallelFor() does not allocate.
+class TaskScheduler {
+public:
+    typedef std::function<void()> Task;
+
+    // workers == 0 runs every task inline on the submitting thread.
+    // When cores is not empty, worker i is pinned to cores[i % cores.size()].
+    TaskScheduler(int workers, const std::vector<int> &cores);
+    ~TaskScheduler();
+
+    void submit(Task task);
+    // Runs body(0) .. body(count - 1) and returns when all of them are done.
+    // The first exception thrown by body is rethrown after that.
+    template <typename Body>
+    void parallelFor(int count, const Body &body) {
+        parallelInvoke(count, &invoke<Body>, &body);
+    }
+
+    // Runs queued tasks on the calling thread until done is set by complete(), for a
+    // caller waiting on work which continues in the scheduler
+    void runUntil(const std::atomic<bool> &done);
+    // Sets done and wakes the thread in runUntil(). done is not touched afterwards, so
+    // the waiter may destroy it as soon as it sees it set.
+    void complete(std::atomic<bool> &done);
+
+    int size() const;
+
+private:
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    // Ring buffer deque, grown when full and never shrunk
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Task> tasks;
+        size_t head;
+        size_t count;
+
+        Queue() : tasks(64), head(0), count(0) {}
+
+        void pushBack(Task &&task);
+        bool popBack(Task &task);
+        bool popFront(Task &task);
+    };
+
+    template <typename Body>
+    static void invoke(const void *body, int index) {
+        (*static_cast<const Body *>(body))(index);
+    }
+
+    void parallelInvoke(int count, void (*invoke)(const void *, int), const void *body);
+    void workerLoop(int index, std::vector<int> cores);
+    bool tryRun(int preferred);
+    int currentWorker() const;
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _pending;
+    std::atomic<unsigned> _nextQueue;
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeUp;
+    bool _stopping;
+};
@@ -6,18 +6,35 @@
 #include <samples/ocv_common.hpp>
 #include <samples/slog.hpp>
 
+#include "allocation_tracker.hpp"
 #include "detectors.hpp"
 #include "feature_extractor.hpp"
 
+class NetworkCache;
+
+// matU8ToBlob keeping the resized image in the caller's buffer, so that it is reused
+// from frame to frame instead of being allocated on every call.
+void matU8ToBlob(const cv::Mat &image, const InferenceEngine::Blob::Ptr &blob, int batchIndex, cv::Mat &resized);
+
 template<typename Component>
 struct Load {
     Component& component;
 
     explicit Load(Component& component);
 
-    void into(InferenceEngine::InferencePlugin & plg, bool enable_dynamic_batch = false) const;
+    // Imports the compiled network from cache when it has it, otherwise compiles the IR
+    // and stores the result in cache, if any
+    void into(InferenceEngine::InferencePlugin & plg, bool enable_dynamic_batch = false,
+              const NetworkCache *cache = nullptr) const;
 };
 
+// Runs inferences synthetic inferences on the request of component at every batch size
+// it is submitted with: 1 .. maxBatch with a dynamic batch, once otherwise. The first
+// inferences of a fresh request are much slower than the following ones. To be called
+// before a completion is installed on the request.
+template<typename Component>
+void warmUp(Component &component, int inferences);
+
 class CallStat {
 public:
     typedef std::chrono::duration<double, std::ratio<1, 1000>> ms;
@@ -39,8 +56,24 @@ private:
 
 class Timer {
 public:
-    void start(const std::string& name);
-    void finish(const std::string& name);
+    // Times its scope under name and charges the allocations made in it to the stage name
+    class Scope {
+    public:
+        Scope(Timer &timer, const std::string &name);
+        ~Scope();
+
+    private:
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        CallStat &_timer;
+        AllocationTracker::Stage _stage;
+    };
+
+    // Times a span which may finish on another thread, such as an inference completing
+    // asynchronously; its allocations are not charged to it.
+    void startSpan(const std::string& name);
+    void finishSpan(const std::string& name);
     CallStat& operator[](const std::string& name);
 
 private:
@@ -0,0 +1,583 @@
+// Native Python binding of FaceRecognitionEngine.
+//
+//   import numpy as np, face_recognition_native as frn
+//   engine = frn.Engine(workers=2)
+//   result = engine.recognize(image)               # blocks, GIL released during inference
+//   future = engine.submit(image)                  # concurrent.futures.Future
+//   engine.queue_stats()['detection']['depth']     # per stage queues, from 'submit' on
+//   engine.swap_model('face_detection', path)      # new network version, without stopping
+//   engine.enroll(path, [('alice', face), ...])    # gallery for swap_model('feature_extraction', ...)
+//   result = await asyncio.wrap_future(engine.submit(image))
+//   np.asarray(result['recognitions'])             # zero-copy view of engine-owned memory
+//   np.asarray(result['aligned_faces'])            # all aligned faces, (faces, rows, cols, 3)
+//
+// Input images are taken through the buffer protocol (HxWx3 uint8, pixel-contiguous) without
+// copying; a submitted image is referenced until its future completes and shall not be modified
+// meanwhile. Output images are frn.Image objects exporting their cv::Mat through the buffer protocol.
+// Submitted images wait in a bounded queue of queue_capacity frames: with queue_policy 'block'
+// submit() waits (GIL released) for a free slot, with 'drop' it raises frn.QueueFull.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "engine.hpp"
+#include "mat_pool.hpp"
+
+// --------------------------- Image --------------------------------------------------------------------
+
+struct ImageObject {
+    PyObject_HEAD
+    cv::Mat mat;
+    int ndim;
+    Py_ssize_t shape[4];
+    Py_ssize_t strides[4];
+};
+
+static void Image_dealloc(ImageObject *self) {
+    self->mat.~Mat();
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+static int Image_getbuffer(ImageObject *self, Py_buffer *view, int flags) {
+    const bool continuous = self->mat.isContinuous();
+    if (!continuous && ((flags & PyBUF_STRIDES) != PyBUF_STRIDES || (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS)) {
+        PyErr_SetString(PyExc_BufferError, "Image is not contiguous");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->buf = self->mat.data;
+    view->obj = reinterpret_cast<PyObject *>(self);
+    Py_INCREF(self);
+    view->len = 1;
+    for (int i = 0; i < self->ndim; ++i) {
+        view->len *= self->shape[i];
+    }
+    view->readonly = 0;
+    view->itemsize = 1;
+    view->format = (flags & PyBUF_FORMAT) ? const_cast<char *>("B") : NULL;
+    view->ndim = self->ndim;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs Image_as_buffer = {
+    reinterpret_cast<getbufferproc>(Image_getbuffer),
+    NULL,
+};
+
+static PyTypeObject ImageType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+static PyObject *wrapImage(const cv::Mat &mat) {
+    ImageObject *self = PyObject_New(ImageObject, &ImageType);
+    if (!self) return NULL;
+    new (&self->mat) cv::Mat(mat);
+    self->ndim = 3;
+    self->shape[0] = mat.rows;
+    self->shape[1] = mat.cols;
+    self->shape[2] = mat.channels();
+    self->strides[0] = mat.step;
+    self->strides[1] = mat.elemSize();
+    self->strides[2] = 1;
+    return reinterpret_cast<PyObject *>(self);
+}
+
+// (faces, rows, cols, 3) view of the aligned faces arena
+static PyObject *wrapArena(const AlignedFaceArena &arena) {
+    ImageObject *self = PyObject_New(ImageObject, &ImageType);
+    if (!self) return NULL;
+    new (&self->mat) cv::Mat(arena.storage());
+    self->ndim = 4;
+    self->shape[0] = arena.size();
+    self->shape[1] = arena.faceSize().height;
+    self->shape[2] = arena.faceSize().width;
+    self->shape[3] = 3;
+    self->strides[0] = arena.slotBytes();
+    self->strides[1] = arena.faceSize().width * 3;
+    self->strides[2] = 3;
+    self->strides[3] = 1;
+    return reinterpret_cast<PyObject *>(self);
+}
+
+// --------------------------- Engine -------------------------------------------------------------------
+
+struct Job {
+    Py_buffer view;
+    cv::Mat image;
+    PyObject *future;
+};
+
+struct EngineObject {
+    PyObject_HEAD
+    FaceRecognitionEngine *engine;
+    MatPool *outputImages;      // recycled once Python drops the result images
+    MpmcQueue<std::unique_ptr<Job>> *jobs;
+    std::vector<std::thread> *workers;
+};
+
+static PyObject *QueueFull = NULL;
+
+static int imageFromBuffer(PyObject *object, Py_buffer &view, cv::Mat &image) {
+    if (PyObject_GetBuffer(object, &view, PyBUF_RECORDS_RO) != 0) {
+        return -1;
+    }
+    if (view.ndim != 3 || view.shape[2] != 3 || view.itemsize != 1 ||
+        view.strides[2] != 1 || view.strides[1] != 3 ||
+        (view.format && std::string(view.format) != "B")) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "Image shall be a HxWx3 uint8 array with contiguous pixels");
+        return -1;
+    }
+    image = cv::Mat(static_cast<int>(view.shape[0]), static_cast<int>(view.shape[1]), CV_8UC3,
+                    view.buf, static_cast<size_t>(view.strides[0]));
+    return 0;
+}
+
+static PyObject *buildResult(const cv::Mat &detectedFacesImage, const cv::Mat &recognizedFacesImage,
+                             const RecognitionResult &recognition) {
+    PyObject *faces = PyList_New(0);
+    if (!faces) return NULL;
+    for (size_t i = 0; i < recognition.detections.size(); ++i) {
+        const cv::Rect &location = recognition.detections[i].location;
+        PyObject *aligned = NULL;
+        if (i < recognition.alignedFaces.size() && !recognition.alignedFaces[i].empty()) {
+            aligned = wrapImage(recognition.alignedFaces[i]);
+        } else {
+            Py_INCREF(Py_None);
+            aligned = Py_None;
+        }
+        PyObject *face = Py_BuildValue("{s:(iiii),s:s,s:f,s:N}",
+                                       "location", location.x, location.y, location.width, location.height,
+                                       "label", i < recognition.persons.size() ? recognition.persons[i].c_str() : "",
+                                       "confidence", recognition.detections[i].confidence,
+                                       "aligned", aligned);
+        if (!face || PyList_Append(faces, face) != 0) {
+            Py_XDECREF(face);
+            Py_DECREF(faces);
+            return NULL;
+        }
+        Py_DECREF(face);
+    }
+    return Py_BuildValue("{s:N,s:N,s:N,s:N,s:d}",
+                         "detections", wrapImage(detectedFacesImage),
+                         "recognitions", wrapImage(recognizedFacesImage),
+                         "faces", faces,
+                         "aligned_faces", wrapArena(recognition.alignedArena),
+                         "time", recognition.recognitionTime);
+}
+
+static void completeJob(EngineObject *self, Job &job) {
+    cv::Mat detectedFacesImage = self->outputImages->acquire(job.image.rows, job.image.cols, CV_8UC3);
+    cv::Mat recognizedFacesImage = self->outputImages->acquire(job.image.rows, job.image.cols, CV_8UC3);
+    RecognitionResult recognition;
+    std::string error;
+    try {
+        self->engine->recognize(job.image, detectedFacesImage, recognizedFacesImage, recognition);
+    }
+    catch (const std::exception &exception) {
+        error = exception.what();
+    }
+
+    PyGILState_STATE state = PyGILState_Ensure();
+    PyObject *outcome = NULL;
+    if (error.empty()) {
+        PyObject *result = buildResult(detectedFacesImage, recognizedFacesImage, recognition);
+        outcome = result ? PyObject_CallMethod(job.future, "set_result", "N", result) : NULL;
+    } else {
+        PyObject *exception = PyObject_CallFunction(PyExc_RuntimeError, "s", error.c_str());
+        outcome = exception ? PyObject_CallMethod(job.future, "set_exception", "N", exception) : NULL;
+    }
+    if (!outcome) {
+        PyErr_WriteUnraisable(job.future);
+    }
+    Py_XDECREF(outcome);
+    PyBuffer_Release(&job.view);
+    Py_DECREF(job.future);
+    PyGILState_Release(state);
+}
+
+static void workerLoop(EngineObject *self) {
+    std::unique_ptr<Job> job;
+    while (self->jobs->pop(job)) {
+        completeJob(self, *job);
+        job.reset();
+    }
+}
+
+static void stopWorkers(EngineObject *self) {
+    if (!self->workers) return;
+    self->jobs->close();
+    // Workers take the GIL to complete their futures.
+    Py_BEGIN_ALLOW_THREADS
+    for (auto &worker : *self->workers) {
+        worker.join();
+    }
+    Py_END_ALLOW_THREADS
+}
+
+static void Engine_dealloc(EngineObject *self) {
+    stopWorkers(self);
+    delete self->workers;
+    delete self->jobs;
+    delete self->outputImages;
+    delete self->engine;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+static int Engine_init(EngineObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"face_detection_model", "facial_landmarks_model", "feature_extraction_model",
+                                     "device", "threshold", "workers", "queue_capacity", "queue_policy", NULL};
+    EngineConfig config;
+    const char *faceDetectionModel = config.faceDetectionModel.c_str();
+    const char *facialLandmarksModel = config.facialLandmarksModel.c_str();
+    const char *featureExtractionModel = config.featureExtractionModel.c_str();
+    const char *deviceName = config.deviceName.c_str();
+    double threshold = config.detectionThreshold;
+    int workers = 2;
+    int queueCapacity = 64;
+    const char *queuePolicy = "block";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ssssdiis", const_cast<char **>(keywords),
+                                     &faceDetectionModel, &facialLandmarksModel, &featureExtractionModel,
+                                     &deviceName, &threshold, &workers, &queueCapacity, &queuePolicy)) {
+        return -1;
+    }
+    if (workers <= 0) {
+        PyErr_SetString(PyExc_ValueError, "workers shall be positive");
+        return -1;
+    }
+    if (queueCapacity <= 0) {
+        PyErr_SetString(PyExc_ValueError, "queue_capacity shall be positive");
+        return -1;
+    }
+    const std::string policy = queuePolicy;
+    if (policy != "block" && policy != "drop") {
+        PyErr_SetString(PyExc_ValueError, "queue_policy shall be 'block' or 'drop'");
+        return -1;
+    }
+    if (self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is already initialized");
+        return -1;
+    }
+    config.faceDetectionModel = faceDetectionModel;
+    config.facialLandmarksModel = facialLandmarksModel;
+    config.featureExtractionModel = featureExtractionModel;
+    config.deviceName = deviceName;
+    config.detectionThreshold = threshold;
+
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        self->engine = new FaceRecognitionEngine(config);
+    }
+    catch (const std::exception &exception) {
+        error = exception.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return -1;
+    }
+
+    self->outputImages = new MatPool(4 * (workers + 1));
+    self->jobs = new MpmcQueue<std::unique_ptr<Job>>("submit", queueCapacity,
+                                                      policy == "drop" ? QueuePolicy::Drop : QueuePolicy::Block);
+    self->workers = new std::vector<std::thread>();
+    for (int i = 0; i < workers; ++i) {
+        self->workers->emplace_back(workerLoop, self);
+    }
+    return 0;
+}
+
+static PyObject *Engine_recognize(EngineObject *self, PyObject *args) {
+    PyObject *object = NULL;
+    if (!PyArg_ParseTuple(args, "O", &object)) return NULL;
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return NULL;
+    }
+
+    Py_buffer view;
+    cv::Mat image;
+    if (imageFromBuffer(object, view, image) != 0) return NULL;
+
+    cv::Mat detectedFacesImage = self->outputImages->acquire(image.rows, image.cols, CV_8UC3);
+    cv::Mat recognizedFacesImage = self->outputImages->acquire(image.rows, image.cols, CV_8UC3);
+    RecognitionResult recognition;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        self->engine->recognize(image, detectedFacesImage, recognizedFacesImage, recognition);
+    }
+    catch (const std::exception &exception) {
+        error = exception.what();
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    return buildResult(detectedFacesImage, recognizedFacesImage, recognition);
+}
+
+static PyObject *Engine_submit(EngineObject *self, PyObject *args) {
+    PyObject *object = NULL;
+    if (!PyArg_ParseTuple(args, "O", &object)) return NULL;
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return NULL;
+    }
+
+    PyObject *futures = PyImport_ImportModule("concurrent.futures");
+    if (!futures) return NULL;
+    PyObject *future = PyObject_CallMethod(futures, "Future", NULL);
+    Py_DECREF(futures);
+    if (!future) return NULL;
+
+    std::unique_ptr<Job> job(new Job());
+    if (imageFromBuffer(object, job->view, job->image) != 0) {
+        Py_DECREF(future);
+        return NULL;
+    }
+    Py_INCREF(future);
+    job->future = future;
+    bool queued = self->jobs->tryPush(job);
+    if (!queued && self->jobs->policy() == QueuePolicy::Block) {
+        // Workers need the GIL to complete the futures which free the slots
+        Py_BEGIN_ALLOW_THREADS
+        queued = self->jobs->push(job);
+        Py_END_ALLOW_THREADS
+    } else if (!queued) {
+        queued = self->jobs->push(job);     // counts the drop
+    }
+    if (!queued) {
+        PyBuffer_Release(&job->view);
+        Py_DECREF(future);
+        Py_DECREF(future);
+        PyErr_SetString(QueueFull, "Recognition queue is full, the frame is dropped");
+        return NULL;
+    }
+    return future;
+}
+
+static PyObject *queueStats(const QueueStats &stats) {
+    return Py_BuildValue("{s:n,s:n,s:n,s:K,s:K,s:K,s:K}",
+                         "capacity", static_cast<Py_ssize_t>(stats.capacity),
+                         "depth", static_cast<Py_ssize_t>(stats.depth),
+                         "high_water", static_cast<Py_ssize_t>(stats.highWater),
+                         "pushed", stats.pushed,
+                         "popped", stats.popped,
+                         "dropped", stats.dropped,
+                         "blocked", stats.blocked);
+}
+
+static PyObject *Engine_queue_stats(EngineObject *self, PyObject *) {
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return NULL;
+    }
+    // The submit queue feeds the engine's own stage queues
+    std::vector<QueueStats> queues = self->engine->queueStats();
+    queues.insert(queues.begin(), self->jobs->stats());
+    PyObject *result = PyDict_New();
+    if (!result) return NULL;
+    for (const QueueStats &stats : queues) {
+        PyObject *queue = queueStats(stats);
+        if (!queue || PyDict_SetItemString(result, stats.name.c_str(), queue) != 0) {
+            Py_XDECREF(queue);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(queue);
+    }
+    return result;
+}
+
+static PyObject *Engine_startup_stats(EngineObject *self, PyObject *) {
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return NULL;
+    }
+    const StartupStats stats = self->engine->startupStats();
+    return Py_BuildValue("{s:d,s:d,s:d,s:d,s:d,s:d,s:d}",
+                         "plugin", stats.plugin,
+                         "face_detection", stats.faceDetection,
+                         "facial_landmarks", stats.facialLandmarks,
+                         "feature_extraction", stats.featureExtraction,
+                         "models", stats.models,
+                         "warm_up", stats.warmUp,
+                         "first_frame", stats.firstFrame);
+}
+
+static PyObject *Engine_swap_model(EngineObject *self, PyObject *args) {
+    const char *model = NULL;
+    const char *path = NULL;
+    const char *galleryPath = NULL;
+    if (!PyArg_ParseTuple(args, "ss|z", &model, &path, &galleryPath)) return NULL;
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return NULL;
+    }
+    const std::string name = model;
+    if (name != "face_detection" && name != "facial_landmarks" && name != "feature_extraction") {
+        PyErr_SetString(PyExc_ValueError, "model shall be 'face_detection', 'facial_landmarks' or 'feature_extraction'");
+        return NULL;
+    }
+    const EngineModels swapped = name == "face_detection" ? EngineModels::FaceDetection :
+                                 name == "facial_landmarks" ? EngineModels::FacialLandmarks :
+                                 EngineModels::FeatureExtraction;
+
+    const std::string modelPath = path;
+    const std::string gallery = galleryPath ? galleryPath : "";
+    std::string error;
+    // Workers keep recognizing on the current network meanwhile
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        self->engine->swapModel(swapped, modelPath, gallery.empty() ? nullptr : Gallery::map(gallery));
+    }
+    catch (const std::exception &exception) {
+        error = exception.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Engine_enroll(EngineObject *self, PyObject *args) {
+    const char *path = NULL;
+    PyObject *pairs = NULL;
+    if (!PyArg_ParseTuple(args, "sO", &path, &pairs)) return NULL;
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return NULL;
+    }
+    PyObject *sequence = PySequence_Fast(pairs, "faces shall be a sequence of (label, image) pairs");
+    if (!sequence) return NULL;
+
+    // The images are referenced, not copied, until the gallery is saved
+    const Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    std::vector<Py_buffer> views(count);
+    std::vector<cv::Mat> faces(count);
+    std::vector<std::string> labels;
+    std::vector<int> rowLabels(count);
+    Py_ssize_t acquired = 0;
+    for (; acquired < count; ++acquired) {
+        const char *label = NULL;
+        PyObject *image = NULL;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(sequence, acquired), "sO", &label, &image) ||
+            imageFromBuffer(image, views[acquired], faces[acquired]) != 0) {
+            break;
+        }
+        auto found = std::find(labels.begin(), labels.end(), label);
+        rowLabels[acquired] = static_cast<int>(found - labels.begin());
+        if (found == labels.end()) labels.push_back(label);
+    }
+
+    std::string error;
+    if (acquired == count) {
+        const std::string galleryPath = path;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            self->engine->enroll(labels, rowLabels, faces)->save(galleryPath);
+        }
+        catch (const std::exception &exception) {
+            error = exception.what();
+        }
+        Py_END_ALLOW_THREADS
+    }
+    for (Py_ssize_t i = 0; i < acquired; ++i) {
+        PyBuffer_Release(&views[i]);
+    }
+    Py_DECREF(sequence);
+
+    if (acquired != count) return NULL;
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef Engine_methods[] = {
+    {"recognize", reinterpret_cast<PyCFunction>(Engine_recognize), METH_VARARGS,
+     "recognize(image) -> dict\nRuns the recognition pipeline, releasing the GIL during inference."},
+    {"submit", reinterpret_cast<PyCFunction>(Engine_submit), METH_VARARGS,
+     "submit(image) -> concurrent.futures.Future\nQueues the image for recognition on an engine worker."},
+    {"queue_stats", reinterpret_cast<PyCFunction>(Engine_queue_stats), METH_NOARGS,
+     "queue_stats() -> dict\nCapacity, depth, high water mark and push/pop/drop/block counts per stage queue."},
+    {"startup_stats", reinterpret_cast<PyCFunction>(Engine_startup_stats), METH_NOARGS,
+     "startup_stats() -> dict\nMilliseconds to load the plugin and networks, to warm them up and to the first recognized frame."},
+    {"swap_model", reinterpret_cast<PyCFunction>(Engine_swap_model), METH_VARARGS,
+     "swap_model(model, path, gallery=None)\nSwaps the network of model while serving; 'feature_extraction' requires the gallery enrolled with it."},
+    {"enroll", reinterpret_cast<PyCFunction>(Engine_enroll), METH_VARARGS,
+     "enroll(path, faces)\nSaves to path the gallery of (label, image) faces embedded by the current feature extraction network."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject EngineType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+// --------------------------- Module -------------------------------------------------------------------
+
+static struct PyModuleDef moduleDef = {
+    PyModuleDef_HEAD_INIT,
+    "face_recognition_native",
+    "Native binding of the face recognition engine",
+    -1,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_face_recognition_native(void) {
+    ImageType.tp_name = "face_recognition_native.Image";
+    ImageType.tp_basicsize = sizeof(ImageObject);
+    ImageType.tp_dealloc = reinterpret_cast<destructor>(Image_dealloc);
+    ImageType.tp_as_buffer = &Image_as_buffer;
+    ImageType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ImageType.tp_doc = "Engine-owned HxWx3 uint8 image exported through the buffer protocol";
+
+    EngineType.tp_name = "face_recognition_native.Engine";
+    EngineType.tp_basicsize = sizeof(EngineObject);
+    EngineType.tp_dealloc = reinterpret_cast<destructor>(Engine_dealloc);
+    EngineType.tp_flags = Py_TPFLAGS_DEFAULT;
+    EngineType.tp_doc = "Engine(face_detection_model, facial_landmarks_model, feature_extraction_model, "
+                        "device, threshold, workers, queue_capacity, queue_policy)";
+    EngineType.tp_methods = Engine_methods;
+    EngineType.tp_init = reinterpret_cast<initproc>(Engine_init);
+    EngineType.tp_new = PyType_GenericNew;
+
+    if (PyType_Ready(&ImageType) < 0 || PyType_Ready(&EngineType) < 0) {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&moduleDef);
+    if (!module) return NULL;
+
+    Py_INCREF(&ImageType);
+    PyModule_AddObject(module, "Image", reinterpret_cast<PyObject *>(&ImageType));
+    Py_INCREF(&EngineType);
+    PyModule_AddObject(module, "Engine", reinterpret_cast<PyObject *>(&EngineType));
+    QueueFull = PyErr_NewException("face_recognition_native.QueueFull", NULL, NULL);
+    if (!QueueFull) return NULL;
+    Py_INCREF(QueueFull);
+    PyModule_AddObject(module, "QueueFull", QueueFull);
+    return module;
+}
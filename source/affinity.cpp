@@ -0,0 +1,70 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <thread>
+
+#include "affinity.hpp"
+
+std::vector<int> availableCores() {
+    std::vector<int> cores;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &set)) {
+                cores.push_back(core);
+            }
+        }
+    }
+#endif
+    if (cores.empty()) {
+        for (int core = 0; core < static_cast<int>(std::thread::hardware_concurrency()); ++core) {
+            cores.push_back(core);
+        }
+    }
+    return cores;
+}
+
+bool pinCurrentThread(const std::vector<int> &cores) {
+#ifdef __linux__
+    if (cores.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores) {
+        if (core < 0 || core >= CPU_SETSIZE) return false;
+        CPU_SET(core, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cores;
+    return false;
+#endif
+}
+
+int coreNode(int core) {
+    int node = 0;
+#ifdef __linux__
+    const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(core);
+    DIR *directory = opendir(path.c_str());
+    if (!directory) return node;
+    while (dirent *entry = readdir(directory)) {
+        if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(directory);
+#else
+    (void)core;
+#endif
+    return node;
+}
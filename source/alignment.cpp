@@ -1,6 +1,7 @@
 #include <alignment.hpp>
 
-cv::Mat alignFace(const cv::Mat &srcImage, std::vector<cv::Point2f> leftEye, std::vector<cv::Point2f> rightEye)
+bool alignFace(const cv::Mat &srcImage, const std::array<cv::Point2f, 2> &leftEye,
+               const std::array<cv::Point2f, 2> &rightEye, cv::Mat &dstFace)
 {
     if (leftEye[1].x >= 0 && rightEye[1].x >= 0) {
 
@@ -16,13 +17,23 @@ cv::Mat alignFace(const cv::Mat &srcImage, std::vector<cv::Point2f> leftEye, std
         double len = sqrt(dx*dx + dy*dy);
         double angle = atan2(dy, dx) * 180.0/CV_PI; // Convert from radians to degrees.
 
-        cv::Mat rot_mat = getRotationMatrix2D(eyesCenter, angle, 1.0f);
+        // getRotationMatrix2D(eyesCenter, angle, 1.0) with its rows scaled so that the
+        // rotated crop lands straight in the destination slot, kept on the stack.
+        auto dstSize = dstFace.size();
+        const double alpha = cos(angle * CV_PI / 180.0);
+        const double beta = sin(angle * CV_PI / 180.0);
+        const double scaleX = double(dstSize.width) / width;
+        const double scaleY = double(dstSize.height) / height;
+        double rotation[6] = {
+            alpha * scaleX, beta * scaleX, ((1 - alpha) * eyesCenter.x - beta * eyesCenter.y) * scaleX,
+            -beta * scaleY, alpha * scaleY, (beta * eyesCenter.x + (1 - alpha) * eyesCenter.y) * scaleY
+        };
+        cv::Mat rot_mat(2, 3, CV_64F, rotation);
 
-        cv::Mat warped;
-        warpAffine(srcImage, warped, rot_mat, warped.size());
+        warpAffine(srcImage, dstFace, rot_mat, dstSize);
 
-        return warped;
+        return true;
     }
 
-    return cv::Mat();
+    return false;
 }
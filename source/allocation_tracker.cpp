@@ -0,0 +1,262 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#include <samples/slog.hpp>
+
+#include "allocation_tracker.hpp"
+
+#ifdef FACE_RECOGNITION_ALLOCATION_TRACKING
+
+namespace {
+
+const int MAX_STAGES = 64;
+const int MAX_DEPTH = 16;
+const size_t STAGE_NAME_SIZE = 32;
+
+struct Stage {
+    char name[STAGE_NAME_SIZE];
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+    double budget;
+};
+
+// Fixed tables, so that neither registering a stage nor counting allocates
+Stage stages[MAX_STAGES];
+std::atomic<int> stageCount(0);
+std::mutex stagesMutex;
+std::atomic<bool> countingEnabled(false);
+std::atomic<uint64_t> frameCount(0);
+
+// Initial-exec TLS is never allocated lazily, so the hooks can use it
+__thread int stageStack[MAX_DEPTH] __attribute__((tls_model("initial-exec")));
+__thread int stageDepth __attribute__((tls_model("initial-exec")));
+
+int registerStage(const char *name) {
+    const int count = stageCount;
+    for (int i = 1; i < count; ++i) {
+        if (std::strncmp(stages[i].name, name, STAGE_NAME_SIZE - 1) == 0) return i;
+    }
+    std::lock_guard<std::mutex> lock(stagesMutex);
+    for (int i = 1; i < stageCount; ++i) {
+        if (std::strncmp(stages[i].name, name, STAGE_NAME_SIZE - 1) == 0) return i;
+    }
+    if (stageCount == MAX_STAGES) return 0;
+    Stage &stage = stages[stageCount];
+    std::strncpy(stage.name, name, STAGE_NAME_SIZE - 1);
+    stage.budget = -1;
+    return stageCount++;
+}
+
+struct StageTableInit {
+    StageTableInit() {
+        std::strncpy(stages[0].name, "other", STAGE_NAME_SIZE - 1);
+        stages[0].budget = -1;
+        stageCount = 1;
+    }
+} stageTableInit;
+
+inline void record(size_t size) {
+    if (!countingEnabled.load(std::memory_order_relaxed)) return;
+    const int depth = stageDepth;
+    Stage &stage = stages[depth > 0 && depth <= MAX_DEPTH ? stageStack[depth - 1] : 0];
+    stage.allocations.fetch_add(1, std::memory_order_relaxed);
+    stage.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *memory, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *memory);
+
+void *malloc(size_t size) noexcept {
+    record(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    record(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, size_t size) noexcept {
+    record(size);
+    return __libc_realloc(memory, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    record(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    record(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memory, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    record(size);
+    void *allocated = __libc_memalign(alignment, size);
+    if (!allocated) return ENOMEM;
+    *memory = allocated;
+    return 0;
+}
+
+void free(void *memory) noexcept {
+    __libc_free(memory);
+}
+
+}  // extern "C"
+
+void *operator new(size_t size) {
+    void *memory = malloc(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new[](size_t size) {
+    void *memory = malloc(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size);
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+    free(memory);
+}
+
+bool AllocationTracker::available() {
+    return true;
+}
+
+void AllocationTracker::start() {
+    countingEnabled = false;
+    for (int i = 0; i < stageCount; ++i) {
+        stages[i].allocations = 0;
+        stages[i].bytes = 0;
+    }
+    frameCount = 0;
+    countingEnabled = true;
+}
+
+void AllocationTracker::stop() {
+    countingEnabled = false;
+}
+
+bool AllocationTracker::counting() {
+    return countingEnabled;
+}
+
+void AllocationTracker::pushStage(const std::string &name) {
+    enterStage(registerStage(name.c_str()));
+}
+
+void AllocationTracker::popStage() {
+    leaveStage();
+}
+
+int AllocationTracker::currentStage() {
+    return stageDepth > 0 ? stageStack[stageDepth - 1] : 0;
+}
+
+void AllocationTracker::enterStage(int stage) {
+    if (stageDepth < MAX_DEPTH) {
+        stageStack[stageDepth] = stage;
+    }
+    ++stageDepth;
+}
+
+void AllocationTracker::leaveStage() {
+    if (stageDepth > 0) --stageDepth;
+}
+
+void AllocationTracker::frameCompleted() {
+    if (countingEnabled) ++frameCount;
+}
+
+uint64_t AllocationTracker::frames() {
+    return frameCount;
+}
+
+void AllocationTracker::setBudget(const std::string &stage, double allocationsPerFrame) {
+    stages[registerStage(stage.c_str())].budget = allocationsPerFrame;
+}
+
+std::vector<AllocationTracker::StageStats> AllocationTracker::stats() {
+    std::vector<StageStats> result;
+    for (int i = 0; i < stageCount; ++i) {
+        StageStats stage;
+        stage.name = stages[i].name;
+        stage.allocations = stages[i].allocations;
+        stage.bytes = stages[i].bytes;
+        stage.budget = stages[i].budget;
+        result.push_back(stage);
+    }
+    return result;
+}
+
+#else
+
+bool AllocationTracker::available() { return false; }
+void AllocationTracker::start() {}
+void AllocationTracker::stop() {}
+bool AllocationTracker::counting() { return false; }
+void AllocationTracker::pushStage(const std::string &) {}
+void AllocationTracker::popStage() {}
+int AllocationTracker::currentStage() { return 0; }
+void AllocationTracker::enterStage(int) {}
+void AllocationTracker::leaveStage() {}
+void AllocationTracker::frameCompleted() {}
+uint64_t AllocationTracker::frames() { return 0; }
+void AllocationTracker::setBudget(const std::string &, double) {}
+std::vector<AllocationTracker::StageStats> AllocationTracker::stats() { return {}; }
+
+#endif
+
+int AllocationTracker::checkBudget(double defaultBudget) {
+    const uint64_t measuredFrames = frames();
+    if (!available() || measuredFrames == 0) {
+        slog::warn << "No frames measured, allocation budget not checked" << slog::endl;
+        return 0;
+    }
+    int violations = 0;
+    for (auto &stage : stats()) {
+        const double perFrame = double(stage.allocations) / measuredFrames;
+        const double budget = stage.budget >= 0 ? stage.budget : defaultBudget;
+        const bool over = perFrame > budget;
+        (over ? slog::err : slog::info) << "Stage " << stage.name << ": " << perFrame << " allocations, "
+                                        << double(stage.bytes) / measuredFrames << " bytes per frame (budget "
+                                        << budget << ")" << slog::endl;
+        violations += over;
+    }
+    return violations;
+}
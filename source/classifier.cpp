@@ -1,59 +1,126 @@
+#include <chrono>
 #include <cmath>
+#include <cstring>
 
 #include "classifier.hpp"
-#include "tmp_database.hpp"
+#include "perf_counters.hpp"
 
-//Fin angle, think about threshold.
-std::string  Classification::classify(std::vector<float> featureVector) {
-    std::map<std::string, float> minimums;
-    for (auto it = classifiedFaces.begin(); it != classifiedFaces.end(); ++it) {
-        auto itFeatureVectors = it->second;
-        float min = 1000000;
-        for (auto itClassifiedFeatureVector = itFeatureVectors.begin(); itClassifiedFeatureVector != itFeatureVectors.end(); ++itClassifiedFeatureVector) {
-            auto classifiedFeatures = *itClassifiedFeatureVector;
-
-            slog::info << "size: " << featureVector.size() << slog::endl;
-//            if ((classifiedFeatures.size() != featureVector.size())) {
-//               // throw std::logic_error("Classified feature vector size does not equal to input feature vector size!");
-//            }
-
-            float dotProduct = 0.f, classifiedFeaturesLength = 0.f, featuresLength = 0.f;
-
-            for (auto i = 0; i  < featureVector.size(); ++i) {
-                dotProduct += classifiedFeatures[i] * featureVector[i];
-                classifiedFeaturesLength += classifiedFeatures[i] * classifiedFeatures[i];
-                featuresLength += featureVector[i] * featureVector[i];
-            }
+namespace {
 
-            classifiedFeaturesLength = sqrtf(classifiedFeaturesLength);            
-            featuresLength = sqrtf(featuresLength);
+const int LANES = 8;
 
-            float angleCos = dotProduct / (classifiedFeaturesLength * featuresLength);
+// Scans the gallery rows for the smallest angle to featureVector and returns its row and
+// cosine. Dimension is the embedding size when known at compile time, so that the loop is
+// fully unrolled, or 0 for the size given at runtime. The sums are kept in LANES
+// independent partial sums, which the compiler maps to vector registers without
+// reordering floating point additions.
+template <int Dimension>
+int nearestRow(const Gallery &gallery, const float *featureVector, int dimension, float featuresLength,
+               float &maxCos) {
+    const int size = Dimension ? Dimension : dimension;
+    const int vectorized = size - size % LANES;
+    float bestCos = -2.f;
+    int bestRow = 0;
+    for (int row = 0; row < gallery.size(); ++row) {
+        const float *classifiedFeatures = gallery.embedding(row);
 
-            if (angleCos < -1.0) angleCos = -1.0 ;
-            else if (angleCos > 1.0) angleCos = 1.0 ;
+        float dotProducts[LANES] = {0.f};
+        float lengths[LANES] = {0.f};
+        for (int i = 0; i < vectorized; i += LANES) {
+            for (int lane = 0; lane < LANES; ++lane) {
+                dotProducts[lane] += classifiedFeatures[i + lane] * featureVector[i + lane];
+                lengths[lane] += classifiedFeatures[i + lane] * classifiedFeatures[i + lane];
+            }
+        }
+        float dotProduct = 0.f, classifiedFeaturesLength = 0.f;
+        for (int lane = 0; lane < LANES; ++lane) {
+            dotProduct += dotProducts[lane];
+            classifiedFeaturesLength += lengths[lane];
+        }
+        for (int i = vectorized; i < size; ++i) {
+            dotProduct += classifiedFeatures[i] * featureVector[i];
+            classifiedFeaturesLength += classifiedFeatures[i] * classifiedFeatures[i];
+        }
 
-            float angle = acosf(angleCos);
+        classifiedFeaturesLength = sqrtf(classifiedFeaturesLength);
 
-            if (angle < min) {
-                min = angle;
-            }
+        float angleCos = dotProduct / (classifiedFeaturesLength * featuresLength);
 
-            //slog::info << it->first << " angleCos : " << angleCos << slog::endl;
-            //slog::info << it->first << " angle : " << angle << slog::endl;
+        if (angleCos < -1.0) angleCos = -1.0 ;
+        else if (angleCos > 1.0) angleCos = 1.0 ;
+
+        // The angle decreases with its cosine, the largest cosine wins without taking acos
+        if (angleCos > bestCos) {
+            bestCos = angleCos;
+            bestRow = row;
         }
-       minimums[it->first] = min;
     }
-    
-    float globalMin = 1000000;
-    auto globalMinIt = minimums.begin();
-    for ( auto minIt = globalMinIt; minIt != minimums.end(); ++minIt) {
-       if (minIt->second < globalMin) {
-           globalMin = minIt->second;
-           globalMinIt = minIt;
-       }
+    maxCos = bestCos;
+    return bestRow;
+}
+
+// Kernels specialized for the common embedding sizes, the generic one for any other
+int nearestRow(const Gallery &gallery, const float *featureVector, int dimension, float featuresLength,
+               float &maxCos) {
+    switch (dimension) {
+    case 128: return nearestRow<128>(gallery, featureVector, dimension, featuresLength, maxCos);
+    case 256: return nearestRow<256>(gallery, featureVector, dimension, featuresLength, maxCos);
+    case 512: return nearestRow<512>(gallery, featureVector, dimension, featuresLength, maxCos);
+    default: return nearestRow<0>(gallery, featureVector, dimension, featuresLength, maxCos);
     }
-    slog::info << globalMinIt->first << " : " << globalMinIt->second << slog::endl;
+}
+
+// Counter of the calling thread, opened on first use; scans only reach it when counting
+TlbMissCounter &threadTlbMissCounter() {
+    static thread_local std::unique_ptr<TlbMissCounter> counter;
+    if (!counter) {
+        counter.reset(new TlbMissCounter());
+    }
+    return *counter;
+}
+
+}  // namespace
+
+Classification::Classification(std::shared_ptr<GalleryReplicas> replicas)
+    : replicas(replicas ? replicas : std::make_shared<GalleryReplicas>(Gallery::builtin(), GalleryPlacement::Local)) {
+}
+
+std::string Classification::classify(const std::vector<float> &featureVector) const {
+    std::string label;
+    classify(featureVector.data(), featureVector.size(), label);
+    return label;
+}
+
+//Fin angle, think about threshold.
+void Classification::classify(const float *featureVector, size_t size, std::string &label) const {
+    int node = 0;
+    const Gallery *gallery = &replicas->local(node);
+    if (gallery->size() == 0) {
+        throw std::logic_error("Gallery is empty");
+    }
+    if (static_cast<int>(size) != gallery->dimension()) {
+        throw std::logic_error("Gallery feature vector size " + std::to_string(gallery->dimension()) +
+                               " does not equal to input feature vector size " + std::to_string(size));
+    }
+
+    const int dimension = gallery->dimension();
+    float featuresLength = 0.f;
+    for (int i = 0; i < dimension; ++i) {
+        featuresLength += featureVector[i] * featureVector[i];
+    }
+    featuresLength = sqrtf(featuresLength);
+
+    // Rows are scanned in storage order, the smallest angle wins
+    TlbMissCounter *tlbMissCounter = replicas->countsTlbMisses() ? &threadTlbMissCounter() : nullptr;
+    const uint64_t tlbMissesStart = tlbMissCounter ? tlbMissCounter->read() : 0;
+    auto scanStart = std::chrono::high_resolution_clock::now();
+    float maxCos = 0.f;
+    const int minRow = nearestRow(*gallery, featureVector, dimension, featuresLength, maxCos);
+
+    std::chrono::duration<double, std::milli> scanTime = std::chrono::high_resolution_clock::now() - scanStart;
+    const uint64_t tlbMisses = tlbMissCounter ? tlbMissCounter->read() - tlbMissesStart : 0;
+    replicas->recordScan(node, uint64_t(gallery->size()) * dimension * sizeof(float), scanTime.count(), tlbMisses);
 
-    return  globalMinIt->first;
+    const char *name = gallery->labelData(gallery->rowLabel(minRow));
+    label.assign(name, strnlen(name, GALLERY_LABEL_SIZE));
 }
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "detection_batcher.hpp"
+#include "utility.hpp"
+
+using namespace InferenceEngine;
+
+DetectionBatcher::DetectionBatcher(const FaceDetection &detector, int requests, int batchSize,
+                                   double windowMilliseconds, int capacity)
+    : _batchSize(std::max(1, std::min(batchSize, detector.maxBatch))),
+      _window(static_cast<long long>(windowMilliseconds * 1000)), _capacity(std::max(1, capacity)),
+      _queue("detection", _capacity), _stats({0, 0}), _stopping(false) {
+    if (!detector.isBatchDynamic && detector.maxBatch > 1) {
+        throw std::logic_error("Batched face detection requires a detector loaded with dynamic batch");
+    }
+    _workers.resize(std::max(1, requests));
+    for (Worker &worker : _workers) {
+        worker.detector.reset(new FaceDetection(detector));
+        worker.detector->request.reset();
+        worker.detector->completion = nullptr;
+        worker.batch.reserve(_batchSize);
+        _idleWorkers.push_back(&worker);
+    }
+    _pending.reserve(_capacity);
+    _dispatcher = std::thread(&DetectionBatcher::dispatch, this);
+}
+
+DetectionBatcher::~DetectionBatcher() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _changed.notify_one();
+    _dispatcher.join();
+    // The dispatcher is done once the last worker is idle, its request may still be running finished()
+    for (Worker &worker : _workers) {
+        worker.detector->wait();
+    }
+}
+
+void DetectionBatcher::warmUp(int inferences) {
+    for (Worker &worker : _workers) {
+        ::warmUp(*worker.detector, inferences);
+    }
+}
+
+int DetectionBatcher::batchSize() const {
+    return _batchSize;
+}
+
+DetectionBatcher::Stats DetectionBatcher::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+QueueStats DetectionBatcher::queueStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _queue.stats(_pending.size());
+}
+
+void DetectionBatcher::detect(const cv::Mat &frame, std::vector<FaceDetection::Result> &results,
+                              const Completion &done) {
+    results.clear();
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_pending.size() >= _capacity) {
+        // Backpressure: the caller waits instead of the queue growing
+        _queue.blocked();
+        _space.wait(lock, [this] { return _pending.size() < _capacity; });
+    }
+    _pending.push_back(Item {&frame, &results, &done, Clock::now() + _window});
+    _queue.pushed(_pending.size());
+    _changed.notify_one();
+}
+
+void DetectionBatcher::dispatch() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        if (_pending.empty()) {
+            if (_stopping && _idleWorkers.size() == _workers.size()) return;
+            _changed.wait(lock);
+            continue;
+        }
+        // Frames arriving after the batch is full open the next one
+        const bool full = static_cast<int>(_pending.size()) >= _batchSize;
+        const bool due = _stopping || _pending.front().deadline <= Clock::now();
+        if (!full && !due) {
+            _changed.wait_until(lock, _pending.front().deadline);
+        } else if (_idleWorkers.empty()) {
+            _changed.wait(lock);
+        } else {
+            Worker &worker = *_idleWorkers.back();
+            _idleWorkers.pop_back();
+            const int size = std::min<int>(_pending.size(), _batchSize);
+            worker.batch.assign(_pending.begin(), _pending.begin() + size);
+            _pending.erase(_pending.begin(), _pending.begin() + size);
+            _queue.popped(size);
+            _space.notify_all();
+            ++_stats.batches;
+            _stats.frames += size;
+            lock.unlock();
+            start(worker);
+            lock.lock();
+        }
+    }
+}
+
+void DetectionBatcher::start(Worker &worker) {
+    FaceDetection &detector = *worker.detector;
+    if (!detector.completion) {
+        // Installed on the first batch, warmUp() runs the request without it
+        detector.completion = [this, &worker](StatusCode status) { finished(worker, status); };
+    }
+    try {
+        for (const Item &item : worker.batch) {
+            detector.enqueue(*item.frame);
+        }
+        detector.submitRequest();
+    }
+    catch (const std::exception &error) {
+        slog::err << "Face detection batch failed: " << error.what() << slog::endl;
+        finished(worker, StatusCode::GENERAL_ERROR);
+    }
+}
+
+void DetectionBatcher::finished(Worker &worker, StatusCode status) {
+    FaceDetection &detector = *worker.detector;
+    if (status == StatusCode::OK) {
+        try {
+            detector.fetchResults();
+            for (const auto &result : detector.results) {
+                worker.batch[result.image].results->push_back(result);
+            }
+        }
+        catch (const std::exception &error) {
+            slog::err << "Face detection batch failed: " << error.what() << slog::endl;
+            status = StatusCode::GENERAL_ERROR;
+        }
+    }
+    // Frames of a failed batch shall not join the next one run on this request
+    detector.enquedFrames = 0;
+    detector.submittedFrames = 0;
+    for (const Item &item : worker.batch) {
+        (*item.done)(status);
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _idleWorkers.push_back(&worker);
+    _changed.notify_one();
+}
@@ -0,0 +1,76 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "detection_decoder.hpp"
+
+namespace {
+
+const int OBJECT_SIZE = 7;
+
+void append(const float *detection, DetectionBatch &batch) {
+    batch.image.push_back(static_cast<int>(detection[0]));
+    batch.label.push_back(static_cast<int>(detection[1]));
+    batch.confidence.push_back(detection[2]);
+    batch.xmin.push_back(detection[3]);
+    batch.ymin.push_back(detection[4]);
+    batch.xmax.push_back(detection[5]);
+    batch.ymax.push_back(detection[6]);
+}
+
+}  // namespace
+
+void DetectionBatch::reserve(size_t capacity) {
+    image.reserve(capacity);
+    label.reserve(capacity);
+    confidence.reserve(capacity);
+    xmin.reserve(capacity);
+    ymin.reserve(capacity);
+    xmax.reserve(capacity);
+    ymax.reserve(capacity);
+}
+
+void DetectionBatch::clear() {
+    image.clear();
+    label.clear();
+    confidence.clear();
+    xmin.clear();
+    ymin.clear();
+    xmax.clear();
+    ymax.clear();
+}
+
+size_t decodeDetectionOutput(const float *detections, int proposals, float threshold, DetectionBatch &batch) {
+    int i = 0;
+#ifdef __SSE2__
+    // Four proposals per step: one compare yields the terminator and the threshold
+    // masks, and only the lanes set in the latter are appended.
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 limit = _mm_set1_ps(threshold);
+    for (; i + 4 <= proposals; i += 4) {
+        const float *d = detections + i * OBJECT_SIZE;
+        const __m128 imageIds = _mm_setr_ps(d[0], d[OBJECT_SIZE], d[2 * OBJECT_SIZE], d[3 * OBJECT_SIZE]);
+        const __m128 confidences = _mm_setr_ps(d[2], d[OBJECT_SIZE + 2], d[2 * OBJECT_SIZE + 2], d[3 * OBJECT_SIZE + 2]);
+        const int terminators = _mm_movemask_ps(_mm_cmplt_ps(imageIds, zero));
+        int accepted = _mm_movemask_ps(_mm_cmpgt_ps(confidences, limit));
+        if (terminators) {
+            // Keep the lanes below the first terminator
+            accepted &= (terminators & -terminators) - 1;
+        }
+        while (accepted) {
+            const int lane = __builtin_ctz(accepted);
+            append(d + lane * OBJECT_SIZE, batch);
+            accepted &= accepted - 1;
+        }
+        if (terminators) {
+            return i + __builtin_ctz(terminators);
+        }
+    }
+#endif
+    for (; i < proposals; ++i) {
+        const float *d = detections + i * OBJECT_SIZE;
+        if (d[0] < 0) break;
+        if (d[2] > threshold) append(d, batch);
+    }
+    return i;
+}
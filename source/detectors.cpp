@@ -24,6 +24,8 @@
 #include <ext_list.hpp>
 
 #include "detectors.hpp"
+#include "network_cache.hpp"
+#include "utility.hpp"
 
 using namespace InferenceEngine;
 
@@ -33,7 +35,7 @@ BaseDetection::BaseDetection(std::string topoName,
                              int maxBatch, bool isBatchDynamic, bool isAsync)
     : topoName(topoName), pathToModel(pathToModel), deviceForInference(deviceForInference),
       maxBatch(maxBatch), isBatchDynamic(isBatchDynamic), isAsync(isAsync),
-      enablingChecked(false), _enabled(false) {
+      enablingChecked(false), _enabled(false), callbackRequest(nullptr) {
     if (isAsync) {
         slog::info << "Use async mode for " << topoName << slog::endl;
     }
@@ -48,9 +50,15 @@ ExecutableNetwork* BaseDetection::operator ->() {
 void BaseDetection::submitRequest() {
     if (!enabled() || request == nullptr) return;
     if (isAsync) {
+        if (completion && callbackRequest != request.get()) {
+            request->SetCompletionCallback<std::function<void(InferRequest, StatusCode)>>(
+                [this](InferRequest, StatusCode status) { completion(status); });
+            callbackRequest = request.get();
+        }
         request->StartAsync();
     } else {
         request->Infer();
+        if (completion) completion(StatusCode::OK);
     }
 }
 
@@ -86,11 +94,15 @@ FaceDetection::FaceDetection(const std::string &pathToModel,
                              double detectionThreshold, bool doRawOutputMessages)
     : BaseDetection("Face Detection", pathToModel, deviceForInference, maxBatch, isBatchDynamic, isAsync),
       detectionThreshold(detectionThreshold), doRawOutputMessages(doRawOutputMessages),
-      enquedFrames(0), width(0), height(0), bb_enlarge_coefficient(1.2), resultsFetched(false) {
+      enquedFrames(0), submittedFrames(0), frameSizes(maxBatch), bb_enlarge_coefficient(1.2), resultsFetched(false) {
 }
 
 void FaceDetection::submitRequest() {
     if (!enquedFrames) return;
+    if (isBatchDynamic) {
+        request->SetBatch(enquedFrames);
+    }
+    submittedFrames = enquedFrames;
     enquedFrames = 0;
     resultsFetched = false;
     results.clear();
@@ -100,21 +112,24 @@ void FaceDetection::submitRequest() {
 void FaceDetection::enqueue(const cv::Mat &frame) {
     if (!enabled()) return;
 
+    if (enquedFrames == maxBatch) {
+        slog::warn << "Number of frames more than maximum(" << maxBatch << ") processed by Face Detection" << slog::endl;
+        return;
+    }
     if (!request) {
         request = net.CreateInferRequestPtr();
     }
 
-    width = frame.cols;
-    height = frame.rows;
+    frameSizes[enquedFrames] = frame.size();
 
     Blob::Ptr  inputBlob = request->GetBlob(input);
 
-    matU8ToBlob<uint8_t>(frame, inputBlob);
+    matU8ToBlob(frame, inputBlob, enquedFrames, resizedFrame);
 
-    enquedFrames = 1;
+    enquedFrames++;
 }
 
-CNNNetwork FaceDetection::read()  {
+CNNNetwork FaceDetection::read(bool withWeights)  {
     slog::info << "Loading network files for Face Detection" << slog::endl;
     CNNNetReader netReader;
     /** Read network model **/
@@ -122,9 +137,10 @@ CNNNetwork FaceDetection::read()  {
     /** Set batch size to 1 **/
     slog::info << "Batch size is set to " << maxBatch << slog::endl;
     netReader.getNetwork().setBatchSize(maxBatch);
-    /** Extract model name and load its weights **/
-    std::string binFileName = fileNameNoExt(pathToModel) + ".bin";
-    netReader.ReadWeights(binFileName);
+    /** Extract model name and map its weights **/
+    if (withWeights) {
+        weights = mapWeights(netReader, fileNameNoExt(pathToModel) + ".bin");
+    }
     /** Read labels (if any)**/
     std::string labelFileName = fileNameNoExt(pathToModel) + ".labels";
 
@@ -194,22 +210,26 @@ void FaceDetection::fetchResults() {
     results.clear();
     if (resultsFetched) return;
     resultsFetched = true;
+    results.reserve(maxProposalCount);
+    decoded.reserve(maxProposalCount);
+    decoded.clear();
     const float *detections = request->GetBlob(output)->buffer().as<float *>();
-
-    for (int i = 0; i < maxProposalCount; i++) {
-        float image_id = detections[i * objectSize + 0];
-        Result r;
-        r.label = static_cast<int>(detections[i * objectSize + 1]);
-        r.confidence = detections[i * objectSize + 2];
-
-        if (r.confidence <= detectionThreshold) {
-            continue;
-        }
-
-        r.location.x = detections[i * objectSize + 3] * width;
-        r.location.y = detections[i * objectSize + 4] * height;
-        r.location.width = detections[i * objectSize + 5] * width - r.location.x;
-        r.location.height = detections[i * objectSize + 6] * height - r.location.y;
+    decodeDetectionOutput(detections, maxProposalCount, detectionThreshold, decoded);
+
+    for (size_t i = 0; i < decoded.size(); i++) {
+        // Slots above a dynamic batch hold stale proposals
+        if (decoded.image[i] >= submittedFrames) continue;
+        results.emplace_back();
+        Result &r = results.back();
+        r.image = decoded.image[i];
+        r.label = decoded.label[i];
+        r.confidence = decoded.confidence[i];
+
+        const cv::Size &frameSize = frameSizes[r.image];
+        r.location.x = decoded.xmin[i] * frameSize.width;
+        r.location.y = decoded.ymin[i] * frameSize.height;
+        r.location.width = decoded.xmax[i] * frameSize.width - r.location.x;
+        r.location.height = decoded.ymax[i] * frameSize.height - r.location.y;
 
         // Make square and enlarge face bounding box for more robust operation of face analytics networks
         int bb_width = r.location.width;
@@ -229,17 +249,11 @@ void FaceDetection::fetchResults() {
         r.location.width = bb_new_width;
         r.location.height = bb_new_height;
 
-        if (image_id < 0) {
-            break;
-        }
         if (doRawOutputMessages) {
             std::cout << "[" << i << "," << r.label << "] element, prob = " << r.confidence <<
                          "    (" << r.location.x << "," << r.location.y << ")-(" << r.location.width << ","
-                      << r.location.height << ")"
-                      << ((r.confidence > detectionThreshold) ? " WILL BE RENDERED!" : "") << std::endl;
+                      << r.location.height << ")" << " WILL BE RENDERED!" << std::endl;
         }
-
-        results.push_back(r);
     }
 }
 
@@ -255,8 +269,9 @@ void FacialLandmarksDetection::submitRequest() {
     if (isBatchDynamic) {
         request->SetBatch(enquedFaces);
     }
-    BaseDetection::submitRequest();
+    // The completion may already be running when submitRequest() returns
     enquedFaces = 0;
+    BaseDetection::submitRequest();
 }
 
 void FacialLandmarksDetection::enqueue(const cv::Mat &face) {
@@ -278,20 +293,40 @@ void FacialLandmarksDetection::enqueue(const cv::Mat &face) {
     enquedFaces++;
 }
 
-std::vector<float> FacialLandmarksDetection::operator[] (int idx) const {
-    std::vector<float> normedLandmarks;
+Blob::Ptr FacialLandmarksDetection::enqueueBatch(int faces) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    if (faces > maxBatch) {
+        slog::warn << "Number of detected faces more than maximum(" << maxBatch << ") processed by Facial Landmarks estimator" << slog::endl;
+        faces = maxBatch;
+    }
+    if (!request) {
+        request = net.CreateInferRequestPtr();
+    }
+
+    enquedFaces = faces;
+    return request->GetBlob(input);
+}
 
-    auto landmarksBlob = request->GetBlob(outputFacialLandmarksBlobName);
-    auto n_lm = landmarksBlob->dims()[0];
-    const float *normed_coordinates = request->GetBlob(outputFacialLandmarksBlobName)->buffer().as<float *>();
+size_t FacialLandmarksDetection::landmarksSize() const {
+    // Blob::dims() returns a reversed copy, the tensor dims are read in place
+    const SizeVector &dims = request->GetBlob(outputFacialLandmarksBlobName)->getTensorDesc().getDims();
+    size_t n_lm = 1;
+    for (size_t i = 1; i < dims.size(); ++i) {
+        n_lm *= dims[i];
+    }
+    return n_lm;
+}
 
-    for (auto i = 0UL; i < n_lm; ++i)
-        normedLandmarks.push_back(normed_coordinates[i + n_lm * idx]);
+static_assert(sizeof(cv::Point2f) == 2 * sizeof(float), "LandmarksView::points() reads the blob as cv::Point2f");
 
-    return normedLandmarks;
+LandmarksBatch FacialLandmarksDetection::landmarks(int faces) const {
+    const float *normed_coordinates = request->GetBlob(outputFacialLandmarksBlobName)->buffer().as<const float *>();
+    return LandmarksBatch { normed_coordinates, landmarksSize(), faces };
 }
 
-CNNNetwork FacialLandmarksDetection::read() {
+CNNNetwork FacialLandmarksDetection::read(bool withWeights) {
     slog::info << "Loading network files for Facial Landmarks Estimation" << slog::endl;
     CNNNetReader netReader;
     // Read network model
@@ -299,9 +334,10 @@ CNNNetwork FacialLandmarksDetection::read() {
     // Set maximum batch size
     netReader.getNetwork().setBatchSize(maxBatch);
     slog::info << "Batch size is set to  " << netReader.getNetwork().getBatchSize() << " for Facial Landmarks Estimation network" << slog::endl;
-    // Extract model name and load its weights
-    std::string binFileName = fileNameNoExt(pathToModel) + ".bin";
-    netReader.ReadWeights(binFileName);
+    // Extract model name and map its weights
+    if (withWeights) {
+        weights = mapWeights(netReader, fileNameNoExt(pathToModel) + ".bin");
+    }
 
     // ---------------------------Check inputs -------------------------------------------------------------
     slog::info << "Checking Facial Landmarks Estimation network inputs" << slog::endl;
@@ -344,9 +380,9 @@ CNNNetwork FacialLandmarksDetection::read() {
         if (!fc) {
             throw std::logic_error("Fully connected layer is not valid");
         }
-        if (fc->_out_num != 70) {
+        if (fc->_out_num != 2 * POINTS) {
             throw std::logic_error("Facial Landmarks Estimation network output layer (" + layer->name + ") has invalid out-size=" +
-                                   std::to_string(fc->_out_num) + ", should be 70");
+                                   std::to_string(fc->_out_num) + ", should be " + std::to_string(2 * POINTS));
         }
         layerNames[layer->name] = true;
     }
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "embedding_batcher.hpp"
+#include "utility.hpp"
+
+using namespace InferenceEngine;
+
+EmbeddingBatcher::EmbeddingBatcher(const FeatureExtraction &extractor, int requests, int batchSize,
+                                   double deadlineMilliseconds, int capacity)
+    : _batchSize(std::max(1, std::min(batchSize, extractor.maxBatch))),
+      _deadline(static_cast<long long>(deadlineMilliseconds * 1000)),
+      _featureVectorSize(extractor.featureVectorSize), _capacity(std::max(1, capacity)),
+      _queue("feature_extraction", _capacity), _stats({0, 0, 0}), _stopping(false) {
+    if (!extractor.isBatchDynamic && extractor.maxBatch > 1) {
+        throw std::logic_error("Batched feature extraction requires an extractor loaded with dynamic batch");
+    }
+    _workers.resize(std::max(1, requests));
+    for (Worker &worker : _workers) {
+        worker.extractor.reset(new FeatureExtraction(extractor));
+        worker.extractor->request.reset();
+        worker.extractor->completion = nullptr;
+        worker.batch.reserve(_batchSize);
+        worker.completed.reserve(_batchSize);
+        _idleWorkers.push_back(&worker);
+    }
+    _pending.reserve(_capacity);
+    _dispatcher = std::thread(&EmbeddingBatcher::dispatch, this);
+}
+
+EmbeddingBatcher::~EmbeddingBatcher() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _changed.notify_one();
+    _dispatcher.join();
+    // The dispatcher is done once the last worker is idle, its request may still be running finished()
+    for (Worker &worker : _workers) {
+        worker.extractor->wait();
+    }
+}
+
+void EmbeddingBatcher::warmUp(int inferences) {
+    for (Worker &worker : _workers) {
+        ::warmUp(*worker.extractor, inferences);
+    }
+}
+
+int EmbeddingBatcher::batchSize() const {
+    return _batchSize;
+}
+
+int EmbeddingBatcher::featureVectorSize() const {
+    return _featureVectorSize;
+}
+
+EmbeddingBatcher::Stats EmbeddingBatcher::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+QueueStats EmbeddingBatcher::queueStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _queue.stats(_pending.size());
+}
+
+EmbeddingBatcher::Caller *EmbeddingBatcher::openCaller() {
+    if (_freeCallers.empty()) {
+        _callers.emplace_back(new Caller());
+        _freeCallers.push_back(_callers.back().get());
+    }
+    Caller *caller = _freeCallers.back();
+    _freeCallers.pop_back();
+    return caller;
+}
+
+void EmbeddingBatcher::embed(const cv::Mat *const *faces, int count, float *embeddings, const Completion &done) {
+    if (count <= 0) {
+        done(StatusCode::OK);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    Caller *caller = openCaller();
+    caller->remaining = count;
+    caller->status = StatusCode::OK;
+    caller->done = &done;
+    const Clock::time_point deadline = Clock::now() + _deadline;
+    bool blocked = false;
+    for (int i = 0; i < count; ++i) {
+        if (_pending.size() >= _capacity) {
+            // Backpressure: the faces queued so far are dispatched while the caller waits
+            if (!blocked) _queue.blocked();
+            blocked = true;
+            _changed.notify_one();
+            _space.wait(lock, [this] { return _pending.size() < _capacity; });
+        }
+        _pending.push_back(Item {faces[i], embeddings + i * _featureVectorSize, caller, deadline});
+        _queue.pushed(_pending.size());
+    }
+    _changed.notify_one();
+}
+
+void EmbeddingBatcher::dispatch() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        if (_pending.empty()) {
+            if (_stopping && _idleWorkers.size() == _workers.size()) return;
+            _changed.wait(lock);
+            continue;
+        }
+        const bool full = static_cast<int>(_pending.size()) >= _batchSize;
+        const bool due = _stopping || _pending.front().deadline <= Clock::now();
+        if (!full && !due) {
+            _changed.wait_until(lock, _pending.front().deadline);
+        } else if (_idleWorkers.empty()) {
+            // A ready batch waiting for an infer request
+            _changed.wait(lock);
+        } else {
+            Worker &worker = *_idleWorkers.back();
+            _idleWorkers.pop_back();
+            const int size = std::min<int>(_pending.size(), _batchSize);
+            worker.batch.assign(_pending.begin(), _pending.begin() + size);
+            _pending.erase(_pending.begin(), _pending.begin() + size);
+            _queue.popped(size);
+            _space.notify_all();
+            ++_stats.batches;
+            _stats.faces += size;
+            _stats.fullBatches += size == _batchSize;
+            lock.unlock();
+            start(worker);
+            lock.lock();
+        }
+    }
+}
+
+void EmbeddingBatcher::start(Worker &worker) {
+    FeatureExtraction &extractor = *worker.extractor;
+    if (!extractor.completion) {
+        // Installed on the first batch, warmUp() runs the request without it
+        extractor.completion = [this, &worker](StatusCode status) { finished(worker, status); };
+    }
+    try {
+        for (const Item &item : worker.batch) {
+            extractor.enqueue(*item.face);
+        }
+        extractor.submitRequest();
+    }
+    catch (const std::exception &error) {
+        slog::err << "Feature extraction batch failed: " << error.what() << slog::endl;
+        finished(worker, StatusCode::GENERAL_ERROR);
+    }
+}
+
+void EmbeddingBatcher::finished(Worker &worker, StatusCode status) {
+    FeatureExtraction &extractor = *worker.extractor;
+    if (status == StatusCode::OK) {
+        try {
+            extractor.fetchResults();
+            for (size_t i = 0; i < worker.batch.size(); ++i) {
+                std::copy(extractor.results.begin() + i * _featureVectorSize,
+                          extractor.results.begin() + (i + 1) * _featureVectorSize, worker.batch[i].embedding);
+            }
+        }
+        catch (const std::exception &error) {
+            slog::err << "Feature extraction batch failed: " << error.what() << slog::endl;
+            status = StatusCode::GENERAL_ERROR;
+        }
+    }
+    // The worker goes back to the idle ones without faces of this batch
+    extractor.enquedFrames = 0;
+    extractor.submittedFrames = 0;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    worker.completed.clear();
+    for (const Item &item : worker.batch) {
+        Caller &caller = *item.caller;
+        if (status != StatusCode::OK) caller.status = status;
+        if (--caller.remaining == 0) {
+            worker.completed.push_back(caller);
+            _freeCallers.push_back(&caller);
+        }
+    }
+    lock.unlock();
+    for (const Caller &caller : worker.completed) {
+        (*caller.done)(caller.status);
+    }
+
+    lock.lock();
+    _idleWorkers.push_back(&worker);
+    _changed.notify_one();
+}
@@ -0,0 +1,792 @@
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+
+#include <inference_engine.hpp>
+
+#include <samples/ocv_common.hpp>
+#include <samples/slog.hpp>
+
+#include <ie_iextension.h>
+#include <ext_list.hpp>
+
+#include "engine.hpp"
+#include "alignment.hpp"
+#include "affinity.hpp"
+#include "allocation_tracker.hpp"
+#include "stage_graph.hpp"
+#include "stages.hpp"
+#include "network_cache.hpp"
+
+using namespace InferenceEngine;
+
+namespace {
+
+// Frame timer name, constructed once so that timing a frame does not allocate;
+// the stages time themselves
+const std::string TOTAL_TIMER = "total";
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Milliseconds taken by reading and compiling the network of component
+template <typename Component>
+double loadNetwork(Component &component, InferencePlugin &plugin, bool enableDynamicBatch,
+                   const NetworkCache *cache) {
+    const auto start = std::chrono::steady_clock::now();
+    Load<Component>(component).into(plugin, enableDynamicBatch, cache);
+    return millisecondsSince(start);
+}
+
+FaceDetection faceDetection(const EngineConfig &config) {
+    return FaceDetection(config.faceDetectionModel, config.deviceName, std::max(1, config.detectionBatch),
+                         config.detectionBatch > 1, config.cpuThreads > 0, config.detectionThreshold, false);
+}
+
+FacialLandmarksDetection facialLandmarksDetection(const EngineConfig &config) {
+    return FacialLandmarksDetection(config.facialLandmarksModel, config.deviceName, config.maxFacesPerFrame, false,
+                                    config.cpuThreads > 0);
+}
+
+FeatureExtraction featureExtraction(const EngineConfig &config) {
+    return FeatureExtraction(config.featureExtractionModel, config.deviceName, std::max(1, config.embeddingBatch),
+                             config.embeddingBatch > 1, config.cpuThreads > 0);
+}
+
+// Model path of config for model, null for a value which is not a model
+std::string *modelPathOf(EngineConfig &config, EngineModels model) {
+    switch (model) {
+    case EngineModels::FaceDetection: return &config.faceDetectionModel;
+    case EngineModels::FacialLandmarks: return &config.facialLandmarksModel;
+    case EngineModels::FeatureExtraction: return &config.featureExtractionModel;
+    default: return nullptr;
+    }
+}
+
+// Waits for a load started by loadModels(), keeping the first error
+void finishLoad(std::future<double> &load, double &duration, std::exception_ptr &error) {
+    if (!load.valid()) return;
+    try {
+        duration = load.get();
+    }
+    catch (...) {
+        if (!error) error = std::current_exception();
+    }
+}
+
+}  // namespace
+
+InferContext::InferContext(const FaceDetection &faceDetector,
+                           const FacialLandmarksDetection &facialLandmarksDetector,
+                           const FeatureExtraction &featureExtractor)
+    : faceDetector(faceDetector), facialLandmarksDetector(facialLandmarksDetector),
+      featureExtractor(featureExtractor), faceBuffers(facialLandmarksDetector.maxBatch), frame(arena),
+      pipeline(nullptr) {
+    // Requests are created on the first enqueue, completions are installed by the engine
+    this->faceDetector.request.reset();
+    this->facialLandmarksDetector.request.reset();
+    this->featureExtractor.request.reset();
+    this->faceDetector.callbackRequest = nullptr;
+    this->facialLandmarksDetector.callbackRequest = nullptr;
+    this->featureExtractor.callbackRequest = nullptr;
+}
+
+InferContext::Frame::Frame(FrameArena &arena)
+    : image(nullptr), detectedFacesImage(nullptr), recognizedFacesImage(nullptr), recognition(nullptr),
+      status(StatusCode::OK), embeddedFaces(ArenaAllocator<const cv::Mat *>(arena)),
+      embeddedSlots(ArenaAllocator<int>(arena)), featureVectors(ArenaAllocator<float>(arena)), submittedFaces(0) {}
+
+void InferContext::Frame::reset(FrameArena &arena) {
+    // The previous buffers were reclaimed by the arena, fresh vectors do not allocate
+    FrameVector<const cv::Mat *>(ArenaAllocator<const cv::Mat *>(arena)).swap(embeddedFaces);
+    FrameVector<int>(ArenaAllocator<int>(arena)).swap(embeddedSlots);
+    FrameVector<float>(ArenaAllocator<float>(arena)).swap(featureVectors);
+    submittedFaces = 0;
+}
+
+void RecognitionResult::clear() {
+    detections.clear();
+    persons.clear();
+    detectedFaces.clear();
+    alignedFaces.clear();
+    alignedArena.clear();
+    recognitionTime = 0.0;
+    dropped = false;
+}
+
+struct FaceRecognitionEngine::ModelSet {
+    // The model paths of the set are those of its networks, config() keeps the initial ones
+    FaceDetection faceDetector;
+    FacialLandmarksDetection facialLandmarksDetector;
+    FeatureExtraction featureExtractor;
+    Classification classifier;
+    unsigned loaded;            // modelMask() of the loaded networks, disabled ones count as loaded
+    // Shared with the next set when a swap keeps their network
+    std::shared_ptr<DetectionBatcher> detectionBatcher;
+    std::shared_ptr<EmbeddingBatcher> embeddingBatcher;
+    std::unique_ptr<StageResources> resources;
+    std::unique_ptr<FramePipeline> pipeline;
+    std::vector<std::unique_ptr<InferContext>> contexts;
+    int inFlight;               // frames still running once the set is retired
+
+    ModelSet(const FaceDetection &faceDetector, const FacialLandmarksDetection &facialLandmarksDetector,
+             const FeatureExtraction &featureExtractor, std::shared_ptr<GalleryReplicas> replicas)
+        : faceDetector(faceDetector), facialLandmarksDetector(facialLandmarksDetector),
+          featureExtractor(featureExtractor), classifier(replicas), loaded(modelMask()), inFlight(0) {
+        // Disabled networks have nothing to load
+        if (!faceDetector.enabled()) loaded |= modelMask(EngineModels::FaceDetection);
+        if (!facialLandmarksDetector.enabled()) loaded |= modelMask(EngineModels::FacialLandmarks);
+        if (!featureExtractor.enabled()) loaded |= modelMask(EngineModels::FeatureExtraction);
+    }
+};
+
+FaceRecognitionEngine::FaceRecognitionEngine(const EngineConfig &config)
+    : _created(Clock::now()), _config(config), _pipelineModels(modelMask()), _assembled(false), _serving(false),
+      _admission("admission", std::max(0, config.maxQueuedFrames)) {
+    if (config.reservedInteractiveRequests >= std::max(1, config.inferRequests)) {
+        throw std::logic_error("Reserved interactive requests shall leave at least one of the " +
+                               std::to_string(config.inferRequests) + " infer requests to the other frames");
+    }
+    if (config.cpuThreads <= 0 && (config.detectionBatch > 1 || config.embeddingBatch > 1)) {
+        // The synchronous batch inference would run the next stages of every frame of the
+        // batch on the dispatcher thread, one after the other, instead of on their callers
+        throw std::logic_error("Batched detection and embedding require CPU stage workers, cpuThreads shall be "
+                               "at least 1");
+    }
+    std::shared_ptr<GalleryReplicas> replicas = config.galleryReplicas ? config.galleryReplicas :
+        std::make_shared<GalleryReplicas>(config.gallery ? config.gallery : Gallery::builtin(),
+                                          GalleryPlacement::Local, config.hugePages);
+
+    // --------------------------- 1. Loading plugin to the Inference Engine -----------------------------
+    _plugin = PluginDispatcher({"../../../lib/intel64", ""}).getPluginByDevice(config.deviceName);
+    _plugin.AddExtension(std::make_shared<Extensions::Cpu::CpuExtensions>());
+    std::map<std::string, std::string> pluginConfig;
+    if (config.deviceName == "CPU" && config.inferRequests > 1) {
+        // Let the CPU plugin execute the contexts' requests in parallel streams
+        pluginConfig[PluginConfigParams::KEY_CPU_THROUGHPUT_STREAMS] = std::to_string(config.inferRequests);
+    }
+    std::vector<int> cpuCores = config.cpuCores;
+    if (config.deviceName == "CPU" && config.inferenceThreads > 0) {
+        pluginConfig[PluginConfigParams::KEY_CPU_THREADS_NUM] = std::to_string(config.inferenceThreads);
+    }
+    if (config.deviceName == "CPU" && config.inferenceThreads > 0 && config.bindInferenceThreads) {
+        // Inference threads are bound to the first cores, the CPU stages get the rest
+        pluginConfig[PluginConfigParams::KEY_CPU_BIND_THREAD] = PluginConfigParams::YES;
+        std::vector<int> cores = availableCores();
+        if (cpuCores.empty() && static_cast<int>(cores.size()) > config.inferenceThreads) {
+            cpuCores.assign(cores.begin() + config.inferenceThreads, cores.end());
+        }
+    }
+    if (!pluginConfig.empty()) {
+        _plugin.SetConfig(pluginConfig);
+    }
+    if (!config.networkCache.empty()) {
+        // The plugin config is part of the key, the networks are compiled for it
+        _networkCache.reset(new NetworkCache(config.networkCache, _plugin, config.deviceName, pluginConfig));
+    }
+    _scheduler.reset(new TaskScheduler(std::max(0, config.cpuThreads), cpuCores));
+    _schedulingStats = SchedulingStats {0, 0, 0, 0};
+    _startupStats = StartupStats {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    _expectedTime = 0.0;
+    if (config.countTlbMisses) {
+        replicas->countTlbMisses(true);
+    }
+    // ---------------------------------------------------------------------------------------------------
+
+    _models.reset(new ModelSet(faceDetection(config), facialLandmarksDetection(config), featureExtraction(config),
+                               replicas));
+    FeatureExtraction &featureExtractor = _models->featureExtractor;
+    if (featureExtractor.enabled()) {
+        // Checked on the IR as swapModel() does, rather than by every frame with faces
+        featureExtractor.read(false);
+        const int dimension = replicas->replica(0).dimension();
+        if (dimension != featureExtractor.featureVectorSize) {
+            throw std::logic_error("Feature extraction network " + featureExtractor.pathToModel + " embeds " +
+                                   std::to_string(featureExtractor.featureVectorSize) + " values, the gallery " +
+                                   std::to_string(dimension));
+        }
+    }
+    createResources(*_models);
+    _startupStats.plugin = millisecondsSince(_created);
+    // With lazy loading, the first frame assembles the default pipeline unless another one
+    // was assembled before, which loads only the networks of its stages
+    if (!config.lazyLoading) {
+        assembleDefault();
+    }
+}
+
+void FaceRecognitionEngine::createResources(ModelSet &set) {
+    // With CPU stage workers the requests run asynchronously and each completion queues
+    // the next stage on the scheduler, so no thread waits for an inference; without them
+    // they run synchronously and the stages follow each other on the calling thread.
+    set.resources.reset(new StageResources {_config, *_scheduler, set.classifier, set.detectionBatcher.get(),
+                                            set.embeddingBatcher.get(),
+                                            [this](InferContext &context, std::exception_ptr error) {
+                                                finishFrame(context, error);
+                                            }});
+}
+
+void FaceRecognitionEngine::assembleDefault() {
+    std::lock_guard<std::mutex> lock(_loadMutex);
+    if (_assembled.load(std::memory_order_acquire)) return;
+    const ModelSet &models = *_models;
+    if (!models.faceDetector.enabled()) {
+        assembleLocked<DrawResults>();
+    } else if (!models.facialLandmarksDetector.enabled()) {
+        assembleLocked<DetectFaces, DrawResults>();
+    } else if (!models.featureExtractor.enabled()) {
+        assembleLocked<DetectFaces, EstimateLandmarks, AlignFaces, DrawResults>();
+    } else {
+        assembleLocked<DetectFaces, EstimateLandmarks, AlignFaces, ExtractFeatures, ClassifyFaces, DrawResults>();
+    }
+}
+
+StartupStats FaceRecognitionEngine::loadModels(ModelSet &set, unsigned models) {
+    StartupStats loaded = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    const unsigned pending = models & ~set.loaded;
+    // A set gets its contexts with its first pipeline, even when it has no network to load
+    if (pending == modelMask() && !set.contexts.empty()) return loaded;
+
+    // --------------------------- 2. Reading IR models and loading them to plugins ----------------------
+    // Each network is parsed and compiled on its own thread, the plugin is configured
+    // beforehand; once frames are served, one after the other unless parallelLoading.
+    // Face detection and feature extraction batch the work of concurrent calls with a
+    // dynamic batch when enabled.
+    const auto start = Clock::now();
+    const bool parallel = _config.parallelLoading || !_serving.load(std::memory_order_relaxed);
+    const std::launch policy = parallel ? std::launch::async : std::launch::deferred;
+    std::future<double> faceDetection, facialLandmarks, featureExtraction;
+    if (pending & modelMask(EngineModels::FaceDetection)) {
+        faceDetection = std::async(policy, [this, &set] {
+            return loadNetwork(set.faceDetector, _plugin, set.faceDetector.isBatchDynamic, _networkCache.get());
+        });
+    }
+    if (pending & modelMask(EngineModels::FacialLandmarks)) {
+        facialLandmarks = std::async(policy, [this, &set] {
+            return loadNetwork(set.facialLandmarksDetector, _plugin, false, _networkCache.get());
+        });
+    }
+    if (pending & modelMask(EngineModels::FeatureExtraction)) {
+        featureExtraction = std::async(policy, [this, &set] {
+            return loadNetwork(set.featureExtractor, _plugin, set.featureExtractor.isBatchDynamic, _networkCache.get());
+        });
+    }
+    // Every load is over before an error is rethrown, they write into the components
+    std::exception_ptr error;
+    finishLoad(faceDetection, loaded.faceDetection, error);
+    finishLoad(facialLandmarks, loaded.facialLandmarks, error);
+    finishLoad(featureExtraction, loaded.featureExtraction, error);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    set.loaded |= pending;
+    loaded.models = millisecondsSince(start);
+    if (pending != modelMask()) {
+        slog::info << "Networks loaded in " << loaded.models << " ms" << slog::endl;
+    }
+    // ----------------------------------------------------------------------------------------------------
+
+    // Every context gets its own infer requests on the shared executable networks
+    set.contexts.clear();
+    for (int i = 0; i < std::max(1, _config.inferRequests); ++i) {
+        set.contexts.emplace_back(new InferContext(set.faceDetector, set.facialLandmarksDetector, set.featureExtractor));
+    }
+    if ((pending & modelMask(EngineModels::FaceDetection)) && _config.detectionBatch > 1) {
+        // One batch fills while the previous ones are inferred
+        const int batches = std::max(1, (_config.inferRequests + _config.detectionBatch - 1) / _config.detectionBatch) + 1;
+        const int capacity = _config.detectionQueue > 0 ? _config.detectionQueue : _config.inferRequests;
+        set.detectionBatcher = std::make_shared<DetectionBatcher>(set.faceDetector, batches, _config.detectionBatch,
+                                                                  _config.detectionWindow, capacity);
+        set.resources->detectionBatcher = set.detectionBatcher.get();
+    }
+    if ((pending & modelMask(EngineModels::FeatureExtraction)) && _config.embeddingBatch > 1) {
+        // At most one batch per concurrent caller runs at a time
+        const int capacity = _config.embeddingQueue > 0 ? _config.embeddingQueue :
+                             std::max(1, _config.inferRequests) * _config.maxFacesPerFrame;
+        set.embeddingBatcher = std::make_shared<EmbeddingBatcher>(set.featureExtractor, std::max(1, _config.inferRequests),
+                                                                  _config.embeddingBatch, _config.embeddingDeadline,
+                                                                  capacity);
+        set.resources->embeddingBatcher = set.embeddingBatcher.get();
+    }
+    loaded.warmUp = warmUp(set, pending);
+    return loaded;
+}
+
+double FaceRecognitionEngine::warmUp(ModelSet &set, unsigned models) {
+    const int inferences = _config.warmUpInferences;
+    if (inferences <= 0) return 0.0;
+    // Requests run concurrently as they do when serving, one thread per context and batcher.
+    // Contexts do not use their own requests of a batched network.
+    const auto start = Clock::now();
+    const bool detection = (set.loaded & modelMask(EngineModels::FaceDetection)) && !set.detectionBatcher;
+    const bool landmarks = (set.loaded & modelMask(EngineModels::FacialLandmarks)) != 0;
+    const bool extraction = (set.loaded & modelMask(EngineModels::FeatureExtraction)) && !set.embeddingBatcher;
+    std::vector<std::future<void>> warmUps;
+    for (auto &context : set.contexts) {
+        InferContext *warmed = context.get();
+        warmUps.push_back(std::async(std::launch::async, [=] {
+            if (detection) ::warmUp(warmed->faceDetector, inferences);
+            if (landmarks) ::warmUp(warmed->facialLandmarksDetector, inferences);
+            if (extraction) ::warmUp(warmed->featureExtractor, inferences);
+        }));
+    }
+    if ((models & modelMask(EngineModels::FaceDetection)) && set.detectionBatcher) {
+        DetectionBatcher *batcher = set.detectionBatcher.get();
+        warmUps.push_back(std::async(std::launch::async, [=] { batcher->warmUp(inferences); }));
+    }
+    if ((models & modelMask(EngineModels::FeatureExtraction)) && set.embeddingBatcher) {
+        EmbeddingBatcher *batcher = set.embeddingBatcher.get();
+        warmUps.push_back(std::async(std::launch::async, [=] { batcher->warmUp(inferences); }));
+    }
+    std::exception_ptr error;
+    for (auto &warming : warmUps) {
+        try {
+            warming.get();
+        }
+        catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    const double duration = millisecondsSince(start);
+    slog::info << "Infer requests warmed up in " << duration << " ms" << slog::endl;
+    return duration;
+}
+
+FaceRecognitionEngine::~FaceRecognitionEngine() {}
+
+void FaceRecognitionEngine::buildPipeline(ModelSet &set) {
+    std::unique_ptr<FramePipeline> pipeline = _pipelineFactory(*set.resources);
+    for (auto &context : set.contexts) {
+        pipeline->bind(*context);
+        context->pipeline = pipeline.get();
+    }
+    set.pipeline = std::move(pipeline);
+}
+
+void FaceRecognitionEngine::setPipeline(unsigned models, PipelineFactory factory) {
+    // A swap shall not replace the set, nor read the factory, meanwhile
+    std::lock_guard<std::mutex> loadLock(_loadMutex);
+    setPipelineLocked(models, std::move(factory));
+}
+
+void FaceRecognitionEngine::setPipelineLocked(unsigned models, PipelineFactory factory) {
+    ModelSet &set = *_models;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_idleContexts.size() != set.contexts.size()) {
+            throw std::logic_error("The pipeline shall be assembled while no frame is in flight");
+        }
+    }
+    const StartupStats loaded = loadModels(set, models);
+    _pipelineFactory = std::move(factory);
+    _pipelineModels = models;
+    buildPipeline(set);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _startupStats.faceDetection += loaded.faceDetection;
+    _startupStats.facialLandmarks += loaded.facialLandmarks;
+    _startupStats.featureExtraction += loaded.featureExtraction;
+    _startupStats.models += loaded.models;
+    _startupStats.warmUp += loaded.warmUp;
+    // Frames which arrived meanwhile wait for the contexts
+    _idleContexts.clear();
+    for (auto &context : set.contexts) {
+        handOver(*context);
+    }
+    _assembled.store(true, std::memory_order_release);
+}
+
+void FaceRecognitionEngine::swapModel(EngineModels model, const std::string &modelPath,
+                                      std::shared_ptr<const Gallery> gallery) {
+    std::lock_guard<std::mutex> loadLock(_loadMutex);
+    const ModelSet &current = *_models;
+    EngineConfig config = _config;
+    std::string *path = modelPathOf(config, model);
+    if (!path) {
+        throw std::logic_error("A swap replaces the network of a single model");
+    }
+    if (path->empty() || modelPath.empty()) {
+        throw std::logic_error("Only the network of an enabled model can be swapped, for another one");
+    }
+    *path = modelPath;
+    // Embeddings of another network are not comparable to the gallery's, even of the same size
+    std::shared_ptr<GalleryReplicas> replicas = current.classifier.replicas;
+    if (model == EngineModels::FeatureExtraction) {
+        if (!gallery || !gallery->enrolledWith(modelPath)) {
+            throw std::logic_error("Feature extraction network " + modelPath +
+                                   " can only be swapped in with a gallery enrolled with it");
+        }
+        replicas = std::make_shared<GalleryReplicas>(gallery, replicas->placement(), _config.hugePages);
+        replicas->countTlbMisses(current.classifier.replicas->countsTlbMisses());
+    } else if (gallery) {
+        throw std::logic_error("Only a feature extraction network comes with a gallery");
+    }
+
+    // The next set copies the kept networks, sharing their executable networks and batchers
+    const auto start = Clock::now();
+    std::unique_ptr<ModelSet> next(new ModelSet(
+        model == EngineModels::FaceDetection ? faceDetection(config) : current.faceDetector,
+        model == EngineModels::FacialLandmarks ? facialLandmarksDetection(config) : current.facialLandmarksDetector,
+        model == EngineModels::FeatureExtraction ? featureExtraction(config) : current.featureExtractor, replicas));
+    next->loaded = current.loaded & ~modelMask(model);
+    if (model == EngineModels::FeatureExtraction) {
+        // Checked on the IR before anything is compiled, also when the network is loaded lazily
+        next->featureExtractor.read(false);
+        if (gallery->dimension() != next->featureExtractor.featureVectorSize) {
+            throw std::logic_error("Feature extraction network " + modelPath + " embeds " +
+                                   std::to_string(next->featureExtractor.featureVectorSize) + " values, the gallery " +
+                                   std::to_string(gallery->dimension()));
+        }
+    }
+    if (model != EngineModels::FaceDetection) next->detectionBatcher = current.detectionBatcher;
+    if (model != EngineModels::FeatureExtraction) next->embeddingBatcher = current.embeddingBatcher;
+    createResources(*next);
+    if (_assembled.load(std::memory_order_acquire)) {
+        loadModels(*next, _pipelineModels);
+        buildPipeline(*next);
+    }
+    slog::info << "Network " << modelPath << " ready to be swapped in after " << millisecondsSince(start) << " ms"
+               << slog::endl;
+
+    // New frames get the contexts of the next set, waiters included; the busy contexts of
+    // the current one are released instead of made idle, the last one ends the drain
+    std::unique_lock<std::mutex> lock(_mutex);
+    _retired = std::move(_models);
+    _retired->inFlight = static_cast<int>(_retired->contexts.size() - _idleContexts.size());
+    _models = std::move(next);
+    _idleContexts.clear();
+    for (auto &context : _models->contexts) {
+        handOver(*context);
+    }
+    const int drained = _retired->inFlight;
+    _drained.wait(lock, [this] { return _retired->inFlight == 0; });
+    std::unique_ptr<ModelSet> retired = std::move(_retired);
+    lock.unlock();
+
+    // The completions of the last requests may still be returning
+    for (auto &context : retired->contexts) {
+        context->faceDetector.wait();
+        context->facialLandmarksDetector.wait();
+        context->featureExtractor.wait();
+    }
+    slog::info << "Network " << modelPath << " swapped in after " << millisecondsSince(start) << " ms, "
+               << drained << " frames drained" << slog::endl;
+    // A completion callback may still be unwinding once its request is ready, so the
+    // requests and batchers of the set are freed a swap later rather than now
+    _released = std::move(retired);
+}
+
+std::shared_ptr<const Gallery> FaceRecognitionEngine::enroll(const std::vector<std::string> &labels,
+                                                             const std::vector<int> &rowLabels,
+                                                             const std::vector<cv::Mat> &faces) {
+    if (rowLabels.size() != faces.size()) {
+        throw std::logic_error("Every enrolled face shall have a row label");
+    }
+    // A copy shares the executable network of the set, which outlives a swap meanwhile
+    std::unique_ptr<FeatureExtraction> extractor;
+    bool loaded;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        extractor.reset(new FeatureExtraction(_models->featureExtractor));
+        loaded = (_models->loaded & modelMask(EngineModels::FeatureExtraction)) != 0;
+    }
+    if (!extractor->enabled()) {
+        throw std::logic_error("Enrollment requires a feature extraction network");
+    }
+    if (!loaded) {
+        // Not loaded yet by the pipeline, enrollment loads its own copy
+        loadNetwork(*extractor, _plugin, extractor->isBatchDynamic, _networkCache.get());
+    }
+    extractor->request.reset();
+    extractor->completion = nullptr;
+    extractor->callbackRequest = nullptr;
+
+    const size_t dimension = static_cast<size_t>(extractor->featureVectorSize);
+    std::vector<std::vector<float>> embeddings;
+    embeddings.reserve(faces.size());
+    for (size_t first = 0; first < faces.size(); first += extractor->maxBatch) {
+        const size_t last = std::min(faces.size(), first + extractor->maxBatch);
+        for (size_t i = first; i < last; ++i) {
+            extractor->enqueue(faces[i]);
+        }
+        extractor->submitRequest();
+        extractor->wait();
+        extractor->fetchResults();
+        for (size_t i = 0; i < last - first; ++i) {
+            embeddings.emplace_back(extractor->results.begin() + i * dimension,
+                                    extractor->results.begin() + (i + 1) * dimension);
+        }
+    }
+    slog::info << faces.size() << " faces enrolled with " << extractor->pathToModel << slog::endl;
+    return Gallery::build(labels, rowLabels, embeddings, modelHash(extractor->pathToModel));
+}
+
+const EngineConfig &FaceRecognitionEngine::config() const {
+    return _config;
+}
+
+std::string FaceRecognitionEngine::modelPath(EngineModels model) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    switch (model) {
+    case EngineModels::FaceDetection: return _models->faceDetector.pathToModel;
+    case EngineModels::FacialLandmarks: return _models->facialLandmarksDetector.pathToModel;
+    case EngineModels::FeatureExtraction: return _models->featureExtractor.pathToModel;
+    default: throw std::logic_error("Not a model");
+    }
+}
+
+std::shared_ptr<GalleryReplicas> FaceRecognitionEngine::galleryReplicas() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _models->classifier.replicas;
+}
+
+DetectionBatcher::Stats FaceRecognitionEngine::detectionStats() const {
+    std::shared_ptr<DetectionBatcher> batcher;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        batcher = _models->detectionBatcher;
+    }
+    return batcher ? batcher->stats() : DetectionBatcher::Stats {0, 0};
+}
+
+EmbeddingBatcher::Stats FaceRecognitionEngine::embeddingStats() const {
+    std::shared_ptr<EmbeddingBatcher> batcher;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        batcher = _models->embeddingBatcher;
+    }
+    return batcher ? batcher->stats() : EmbeddingBatcher::Stats {0, 0, 0};
+}
+
+SchedulingStats FaceRecognitionEngine::schedulingStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _schedulingStats;
+}
+
+std::vector<QueueStats> FaceRecognitionEngine::queueStats() const {
+    std::vector<QueueStats> queues;
+    std::shared_ptr<DetectionBatcher> detectionBatcher;
+    std::shared_ptr<EmbeddingBatcher> embeddingBatcher;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        queues.push_back(_admission.stats(_waiters.size()));
+        detectionBatcher = _models->detectionBatcher;
+        embeddingBatcher = _models->embeddingBatcher;
+    }
+    if (detectionBatcher) queues.push_back(detectionBatcher->queueStats());
+    if (embeddingBatcher) queues.push_back(embeddingBatcher->queueStats());
+    return queues;
+}
+
+StartupStats FaceRecognitionEngine::startupStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _startupStats;
+}
+
+bool servedBefore(const FrameOptions &left, const FrameOptions &right) {
+    if (left.priority != right.priority) {
+        return left.priority > right.priority;
+    }
+    // Fresh frames before re-verifications, then the earliest deadline
+    if (left.reverification != right.reverification) {
+        return !left.reverification;
+    }
+    return left.deadline < right.deadline;
+}
+
+void FaceRecognitionEngine::dropFrame(const FrameOptions &options, unsigned long long &counter) {
+    ++counter;
+    if (options.reverification) {
+        ++_schedulingStats.reverificationsDropped;
+    }
+}
+
+InferContext *FaceRecognitionEngine::acquireContext(const FrameOptions &options) {
+    const bool hasDeadline = options.deadline != Clock::time_point::max();
+    std::unique_lock<std::mutex> lock(_mutex);
+    InferContext *context = nullptr;
+    // Waiters left with only reserved contexts idle do not keep interactive frames from them
+    auto first = std::min_element(_waiters.begin(), _waiters.end(),
+                                  [](const Waiter *left, const Waiter *right) { return left->before(*right); });
+    const bool overtakes = _waiters.empty() || servedBefore(options, (*first)->options) ||
+                           !mayUseIdleContext((*first)->options);
+    if (overtakes && mayUseIdleContext(options)) {
+        context = _idleContexts.back();
+        _idleContexts.pop_back();
+    } else {
+        Waiter self(options);
+        if (_config.maxQueuedFrames > 0 && static_cast<int>(_waiters.size()) >= _config.maxQueuedFrames) {
+            // The queue stays bounded: the least urgent of the queued frames and this one is shed
+            auto last = std::max_element(_waiters.begin(), _waiters.end(),
+                                         [](const Waiter *left, const Waiter *right) { return left->before(*right); });
+            _admission.dropped();
+            if (!self.before(**last)) {
+                dropFrame(options, _schedulingStats.shed);
+                return nullptr;
+            }
+            (*last)->shed = true;
+            (*last)->granted.notify_one();
+            _waiters.erase(last);
+            _admission.popped();
+        }
+        _waiters.push_back(&self);
+        _admission.pushed(_waiters.size());
+        while (!self.context && !self.shed && (!hasDeadline || Clock::now() < options.deadline)) {
+            if (hasDeadline) {
+                self.granted.wait_until(lock, options.deadline);
+            } else {
+                self.granted.wait(lock);
+            }
+        }
+        if (self.shed) {
+            dropFrame(options, _schedulingStats.shed);
+            return nullptr;
+        }
+        if (!self.context) {
+            _waiters.erase(std::find(_waiters.begin(), _waiters.end(), &self));
+            _admission.popped();
+            dropFrame(options, _schedulingStats.expired);
+            return nullptr;
+        }
+        context = self.context;
+    }
+
+    // A frame which cannot be recognized before its deadline is dropped before detection
+    const auto expectedTime = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(_expectedTime));
+    if (hasDeadline && Clock::now() + expectedTime > options.deadline) {
+        dropFrame(options, _schedulingStats.expired);
+        handOver(*context);
+        return nullptr;
+    }
+    return context;
+}
+
+bool FaceRecognitionEngine::mayUseIdleContext(const FrameOptions &options) const {
+    const int reserved = options.priority == FramePriority::Interactive ? 0 : _config.reservedInteractiveRequests;
+    return static_cast<int>(_idleContexts.size()) > reserved;
+}
+
+void FaceRecognitionEngine::handOver(InferContext &context) {
+    if (_retired && _retired->pipeline && context.pipeline == _retired->pipeline.get()) {
+        // A context of swapped out networks is not used again
+        if (--_retired->inFlight == 0) {
+            _drained.notify_all();
+        }
+        return;
+    }
+    _idleContexts.push_back(&context);
+    if (_waiters.empty()) return;
+    // Interactive frames are served first, so the first waiter is the only one which may
+    // get the context; others wait while only the reserved contexts are idle.
+    auto first = std::min_element(_waiters.begin(), _waiters.end(),
+                                  [](const Waiter *left, const Waiter *right) { return left->before(*right); });
+    Waiter &waiter = **first;
+    if (!mayUseIdleContext(waiter.options)) return;
+    _waiters.erase(first);
+    _admission.popped();
+    waiter.context = _idleContexts.back();
+    _idleContexts.pop_back();
+    waiter.granted.notify_one();
+}
+
+void FaceRecognitionEngine::releaseContext(InferContext &context) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    handOver(context);
+}
+
+void FaceRecognitionEngine::recognize(const cv::Mat &image, cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                                      RecognitionResult &recognition) {
+    recognize(image, detectedFacesImage, recognizedFacesImage, recognition, FrameOptions());
+}
+
+void FaceRecognitionEngine::recognize(const cv::Mat &image, cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                                      RecognitionResult &recognition, const FrameOptions &options) {
+    // The caller runs scheduler tasks until its frame is done instead of waiting for
+    // the inferences; the callback captures a single pointer and does not allocate.
+    struct Completion {
+        TaskScheduler &scheduler;
+        std::atomic<bool> done;
+        std::exception_ptr error;
+
+        explicit Completion(TaskScheduler &scheduler) : scheduler(scheduler), done(false) {}
+    } completion(*_scheduler);
+    Completion *pending = &completion;
+    recognizeAsync(image, detectedFacesImage, recognizedFacesImage, recognition, options,
+                   [pending](std::exception_ptr error) {
+                       pending->error = error;
+                       pending->scheduler.complete(pending->done);
+                   });
+    _scheduler->runUntil(completion.done);
+    if (completion.error) {
+        std::rethrow_exception(completion.error);
+    }
+}
+
+void FaceRecognitionEngine::recognizeAsync(const cv::Mat &image, cv::Mat &detectedFacesImage,
+                                           cv::Mat &recognizedFacesImage, RecognitionResult &recognition,
+                                           const FrameOptions &options, RecognitionCallback done) {
+    if (!_serving.load(std::memory_order_relaxed)) {
+        _serving.store(true, std::memory_order_relaxed);
+    }
+    if (!_assembled.load(std::memory_order_acquire)) {
+        assembleDefault();
+    }
+    InferContext *context = acquireContext(options);
+    if (!context) {
+        recognition.clear();
+        recognition.dropped = true;
+        done(nullptr);
+        return;
+    }
+    InferContext::Frame &frame = context->frame;
+    frame.image = &image;
+    frame.detectedFacesImage = &detectedFacesImage;
+    frame.recognizedFacesImage = &recognizedFacesImage;
+    frame.recognition = &recognition;
+    frame.done = std::move(done);
+    frame.status = StatusCode::OK;
+
+    recognition.clear();
+    // Aligned faces are produced at the feature extractor input resolution
+    cv::Size alignedFaceSize = context->featureExtractor.inputSize;
+    if (alignedFaceSize.area() == 0) {
+        alignedFaceSize = cv::Size(DESIRED_FACE_WIDTH, DESIRED_FACE_HEIGHT);
+    }
+    recognition.alignedArena.reserve(_config.maxFacesPerFrame, alignedFaceSize, _config.hugePages);
+
+    context->timer.startSpan(TOTAL_TIMER);
+    context->arena.reset();
+    frame.reset(context->arena);
+    context->pipeline->start(*context);
+}
+
+void FaceRecognitionEngine::finishFrame(InferContext &context, std::exception_ptr error) {
+    if (!error) {
+        context.timer.finishSpan(TOTAL_TIMER);
+        RecognitionResult &recognition = *context.frame.recognition;
+        recognition.recognitionTime = context.timer[TOTAL_TIMER].getSmoothedDuration();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _expectedTime = recognition.recognitionTime;
+            ++_schedulingStats.recognized;
+            if (_startupStats.firstFrame == 0.0) {
+                _startupStats.firstFrame = millisecondsSince(_created);
+                slog::info << "First frame recognized " << _startupStats.firstFrame << " ms after the engine was created"
+                           << slog::endl;
+            }
+        }
+        AllocationTracker::frameCompleted();
+    }
+    RecognitionCallback done;
+    done.swap(context.frame.done);
+    releaseContext(context);
+    done(error);
+}
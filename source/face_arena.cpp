@@ -0,0 +1,76 @@
+#include "face_arena.hpp"
+#include "mat_allocator.hpp"
+
+AlignedFaceArena::AlignedFaceArena() : _capacity(0), _hugePages(HugePages::None) {
+}
+
+void AlignedFaceArena::reserve(int capacity, const cv::Size &faceSize, HugePages hugePages) {
+    clear();
+    if (capacity == _capacity && faceSize.width == _faceSize.width && faceSize.height == _faceSize.height &&
+        hugePages == _hugePages) {
+        return;
+    }
+    _capacity = capacity;
+    _faceSize = faceSize;
+    _hugePages = hugePages;
+    // A new Mat, so that views of the previous buffer keep it alive
+    _storage = cv::Mat();
+    _storage.allocator = hugePageMatAllocator(hugePages);
+    _storage.create(capacity * faceSize.height, faceSize.width, CV_8UC3);
+    _table.reserve(capacity);
+}
+
+void AlignedFaceArena::clear() {
+    _table.clear();
+}
+
+cv::Mat AlignedFaceArena::allocate() {
+    if (size() >= _capacity) {
+        return cv::Mat();
+    }
+    const int index = size();
+    AlignedFaceRecord record;
+    record.offset = index * slotBytes();
+    record.rows = _faceSize.height;
+    record.cols = _faceSize.width;
+    _table.push_back(record);
+    return _storage.rowRange(index * _faceSize.height, (index + 1) * _faceSize.height);
+}
+
+void AlignedFaceArena::reject(int index) {
+    if (index < 0 || index >= size()) return;
+    _table[index].rows = 0;
+    _table[index].cols = 0;
+}
+
+int AlignedFaceArena::capacity() const {
+    return _capacity;
+}
+
+int AlignedFaceArena::size() const {
+    return static_cast<int>(_table.size());
+}
+
+cv::Size AlignedFaceArena::faceSize() const {
+    return _faceSize;
+}
+
+size_t AlignedFaceArena::slotBytes() const {
+    return static_cast<size_t>(_faceSize.width) * _faceSize.height * 3;
+}
+
+size_t AlignedFaceArena::usedBytes() const {
+    return _table.size() * slotBytes();
+}
+
+const unsigned char *AlignedFaceArena::data() const {
+    return _storage.data;
+}
+
+const cv::Mat &AlignedFaceArena::storage() const {
+    return _storage;
+}
+
+const std::vector<AlignedFaceRecord> &AlignedFaceArena::table() const {
+    return _table;
+}
@@ -1,13 +1,15 @@
 #include <cstdint>
 
 #include "feature_extractor.hpp"
+#include "network_cache.hpp"
+#include "utility.hpp"
 
 FeatureExtraction::FeatureExtraction(const std::string &pathToModel,
                              const std::string &deviceForInference,
                              int maxBatch, bool isBatchDynamic, bool isAsync)
     : topoName("Feature extraction"), pathToModel(pathToModel), deviceForInference(deviceForInference),
       maxBatch(maxBatch), isBatchDynamic(isBatchDynamic), isAsync(isAsync),
-      enablingChecked(false), _enabled(false), enquedFrames(0), width(0), height(0), resultsFetched(false) {
+      enablingChecked(false), _enabled(false), callbackRequest(nullptr), enquedFrames(0), submittedFrames(0), width(0), height(0), resultsFetched(false) {
     if (isAsync) {
         slog::info << "Use async mode for " << topoName << slog::endl;
     }
@@ -34,6 +36,10 @@ bool FeatureExtraction::enabled() const  {
 
 void FeatureExtraction::enqueue(const cv::Mat &frame) {
     if (!enabled()) return;
+    if (enquedFrames == maxBatch) {
+        slog::warn << "Number of faces more than maximum(" << maxBatch << ") processed by Feature Extractor" << slog::endl;
+        return;
+    }
 
     if (!request) {
         request = net.CreateInferRequestPtr();
@@ -44,22 +50,32 @@ void FeatureExtraction::enqueue(const cv::Mat &frame) {
 
     InferenceEngine::Blob::Ptr  inputBlob = request->GetBlob(input);
 
-    matU8ToBlob<uint8_t>(frame, inputBlob);
+    matU8ToBlob(frame, inputBlob, enquedFrames, resizedFrame);
 
-    enquedFrames = 1;
+    enquedFrames++;
 }
 
 void FeatureExtraction::submitRequest() {
     if (!enquedFrames) return;
+    if (isBatchDynamic) {
+        request->SetBatch(enquedFrames);
+    }
+    submittedFrames = enquedFrames;
     enquedFrames = 0;
     resultsFetched = false;
     results.clear();
 
     if (!enabled() || request == nullptr) return;
     if (isAsync) {
+        if (completion && callbackRequest != request.get()) {
+            request->SetCompletionCallback<std::function<void(InferenceEngine::InferRequest, InferenceEngine::StatusCode)>>(
+                [this](InferenceEngine::InferRequest, InferenceEngine::StatusCode status) { completion(status); });
+            callbackRequest = request.get();
+        }
         request->StartAsync();
     } else {
         request->Infer();
+        if (completion) completion(InferenceEngine::StatusCode::OK);
     }
 }
 
@@ -69,7 +85,7 @@ void FeatureExtraction::wait() {
     request->Wait(InferenceEngine::IInferRequest::WaitMode::RESULT_READY);
 }
 
-InferenceEngine::CNNNetwork FeatureExtraction::read()  {
+InferenceEngine::CNNNetwork FeatureExtraction::read(bool withWeights)  {
     slog::info << "Loading network files for Feature Extractor" << slog::endl;
     InferenceEngine::CNNNetReader netReader;
     /** Read network model **/
@@ -77,9 +93,10 @@ InferenceEngine::CNNNetwork FeatureExtraction::read()  {
     /** Set batch size to 1 **/
     slog::info << "Batch size is set to " << maxBatch << slog::endl;
     netReader.getNetwork().setBatchSize(maxBatch);
-    /** Extract model name and load its weights **/
-    std::string binFileName = fileNameNoExt(pathToModel) + ".bin";
-    netReader.ReadWeights(binFileName);
+    /** Extract model name and map its weights **/
+    if (withWeights) {
+        weights = mapWeights(netReader, fileNameNoExt(pathToModel) + ".bin");
+    }
    // -----------------------------------------------------------------------------------------------------
 
     // ---------------------------Check inputs -------------------------------------------------------------
@@ -90,6 +107,11 @@ InferenceEngine::CNNNetwork FeatureExtraction::read()  {
     }
     InferenceEngine::InputInfo::Ptr inputInfoFirst = inputInfo.begin()->second;
     inputInfoFirst->setPrecision(InferenceEngine::Precision::U8);
+    const InferenceEngine::SizeVector inputDims = inputInfoFirst->getTensorDesc().getDims();
+    if (inputDims.size() != 4) {
+        throw std::logic_error("Feature Extractor network input shall be NCHW");
+    }
+    inputSize = cv::Size(static_cast<int>(inputDims[3]), static_cast<int>(inputDims[2]));
 
     // -----------------------------------------------------------------------------------------------------
 
@@ -102,31 +124,21 @@ InferenceEngine::CNNNetwork FeatureExtraction::read()  {
     InferenceEngine::DataPtr& _output = outputInfo.begin()->second;
     output = outputInfo.begin()->first;
 
-    const InferenceEngine::CNNLayerPtr outputLayer = netReader.getNetwork().getLayerByName(output.c_str());
-    if (outputLayer->type != "FullyConnected") {
-        throw std::logic_error("Feature Extractor network output layer(" + outputLayer->name +
-                               ") should be DetectionOutput, but was " +  outputLayer->type);
-    }
-
-    if (outputLayer->params.find("out-size") == outputLayer->params.end()) {
-        throw std::logic_error("Feature Extractor network output layer (" +
-                               output + ") should have out-size integer attribute");
-    }
-
-    const int outSize = outputLayer->GetParamAsInt("out-size");
-    if (outSize != 512) {
-        throw std::logic_error("Feature Extraction networkout-size integer attribute shall be equal to 512");
-    }
-
+    // Any embedding size is accepted, the classifier picks its kernel by the size.
+    // The embedding is read per face as all the values after the batch dimension.
     const InferenceEngine::SizeVector outputDims = _output->getTensorDesc().getDims();
-    featureVectorSize = outputDims[1];
-    if (featureVectorSize != outSize) {
-        throw std::logic_error("Feature Extraction network output layer should have 512 as a last dimension");
+    if (outputDims.size() < 2) {
+        throw std::logic_error("Feature Extraction network output shall have a batch and an embedding dimension, but has " +
+                               std::to_string(outputDims.size()) + " dimensions");
     }
-    if (outputDims.size() != 2) {
-        throw std::logic_error("Feature Extraction network output dimensions not compatible shoulld be 2, but was " +
-                               std::to_string(outputDims.size()));
+    featureVectorSize = 1;
+    for (size_t i = 1; i < outputDims.size(); ++i) {
+        featureVectorSize *= static_cast<int>(outputDims[i]);
     }
+    if (featureVectorSize <= 0) {
+        throw std::logic_error("Feature Extraction network output (" + output + ") is empty");
+    }
+    slog::info << "Embedding size is " << featureVectorSize << slog::endl;
     _output->setPrecision(InferenceEngine::Precision::FP32);
 
     slog::info << "Loading Feature Extraction model to the "<< deviceForInference << " plugin" << slog::endl;
@@ -139,13 +151,9 @@ void FeatureExtraction::fetchResults() {
     results.clear();
     if (resultsFetched) return;
     resultsFetched = true;
-    const float *featureVector = request->GetBlob(output)->buffer().as<float *>();
-
-    for (int i = 0; i < featureVectorSize; ++i) {
-        results.push_back(featureVector[i]);
-        slog::info << featureVector[i] << ' ';
-    }
-    slog::info << slog::endl;
+    results.reserve(maxBatch * featureVectorSize);
+    const float *featureVectors = request->GetBlob(output)->buffer().as<float *>();
+    results.assign(featureVectors, featureVectors + submittedFrames * featureVectorSize);
 }
 
 void FeatureExtraction::printPerformanceCounts() {
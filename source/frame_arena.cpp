@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "frame_arena.hpp"
+
+FrameArena::FrameArena(size_t blockSize) : _blockSize(blockSize), _block(0), _offset(0), _used(0) {
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment) {
+    for (; _block < _blocks.size(); ++_block, _offset = 0) {
+        Block &block = _blocks[_block];
+        const uintptr_t address = reinterpret_cast<uintptr_t>(block.data.get()) + _offset;
+        const size_t padding = (alignment - address % alignment) % alignment;
+        if (_offset + padding + bytes <= block.size) {
+            _offset += padding + bytes;
+            _used += bytes;
+            return block.data.get() + _offset - bytes;
+        }
+    }
+
+    Block block;
+    block.size = std::max(_blockSize, bytes + alignment);
+    block.data.reset(new unsigned char[block.size]);
+    _blocks.push_back(std::move(block));
+    _block = _blocks.size() - 1;
+    _offset = 0;
+    return allocate(bytes, alignment);
+}
+
+void FrameArena::reset() {
+    // A frame which needed several blocks gets one block of their total size
+    if (_blocks.size() > 1) {
+        _blockSize = capacity();
+        _blocks.clear();
+    }
+    _block = 0;
+    _offset = 0;
+    _used = 0;
+}
+
+size_t FrameArena::used() const {
+    return _used;
+}
+
+size_t FrameArena::capacity() const {
+    size_t total = 0;
+    for (auto &block : _blocks) {
+        total += block.size;
+    }
+    return total;
+}
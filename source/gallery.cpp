@@ -0,0 +1,236 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+#include <samples/slog.hpp>
+
+#include "gallery.hpp"
+#include "network_cache.hpp"
+#include "node_memory.hpp"
+#include "tmp_database.hpp"
+
+static_assert(sizeof(GalleryHeader) == 64, "GalleryHeader layout changed");
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment = 64) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+Gallery::Gallery() : _base(nullptr), _size(0), _mapped(false), _nodeMemory(false), _hugePages(HugePages::None) {
+}
+
+Gallery::~Gallery() {
+    if (_mapped) {
+        munmap(const_cast<unsigned char *>(_base), _size);
+    }
+    if (_nodeMemory) {
+        freeNodeMemory(const_cast<unsigned char *>(_base), _size, _hugePages);
+    }
+}
+
+std::shared_ptr<const Gallery> Gallery::builtin() {
+    static std::shared_ptr<const Gallery> gallery;
+    static std::once_flag built;
+    std::call_once(built, [] {
+        std::vector<std::string> labels;
+        std::vector<int> rowLabels;
+        std::vector<std::vector<float>> embeddings;
+        for (auto &&person : classifiedFaces) {
+            labels.push_back(person.first);
+            for (auto &&embedding : person.second) {
+                rowLabels.push_back(static_cast<int>(labels.size()) - 1);
+                embeddings.push_back(embedding);
+            }
+        }
+        gallery = build(labels, rowLabels, embeddings);
+    });
+    return gallery;
+}
+
+std::shared_ptr<const Gallery> Gallery::build(const std::vector<std::string> &labels,
+                                              const std::vector<int> &rowLabels,
+                                              const std::vector<std::vector<float>> &embeddings,
+                                              uint64_t embeddingModel) {
+    if (rowLabels.size() != embeddings.size()) {
+        throw std::logic_error("Gallery shall have one label per embedding");
+    }
+    for (auto &&label : labels) {
+        if (label.size() >= GALLERY_LABEL_SIZE) {
+            throw std::logic_error("Gallery label " + label + " is longer than " +
+                                   std::to_string(GALLERY_LABEL_SIZE - 1) + " characters");
+        }
+    }
+    // Rows shorter than the longest one are zero padded
+    size_t dimension = 0;
+    for (auto &&embedding : embeddings) {
+        dimension = std::max(dimension, embedding.size());
+    }
+
+    GalleryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = GALLERY_MAGIC;
+    header.version = GALLERY_VERSION;
+    header.dimension = static_cast<uint32_t>(dimension);
+    header.count = static_cast<uint32_t>(embeddings.size());
+    header.labelCount = static_cast<uint32_t>(labels.size());
+    header.labelsOffset = alignUp(sizeof(GalleryHeader));
+    header.rowLabelsOffset = alignUp(header.labelsOffset + labels.size() * GALLERY_LABEL_SIZE);
+    header.embeddingsOffset = alignUp(header.rowLabelsOffset + rowLabels.size() * sizeof(uint32_t));
+    header.size = alignUp(header.embeddingsOffset + embeddings.size() * dimension * sizeof(float));
+    header.embeddingModel = embeddingModel;
+
+    std::shared_ptr<Gallery> gallery(new Gallery());
+    gallery->_owned.assign(header.size / sizeof(uint64_t), 0);
+    unsigned char *base = reinterpret_cast<unsigned char *>(gallery->_owned.data());
+    std::memcpy(base, &header, sizeof(header));
+    for (size_t i = 0; i < labels.size(); ++i) {
+        std::strncpy(reinterpret_cast<char *>(base + header.labelsOffset + i * GALLERY_LABEL_SIZE),
+                     labels[i].c_str(), GALLERY_LABEL_SIZE - 1);
+    }
+    uint32_t *rowLabelData = reinterpret_cast<uint32_t *>(base + header.rowLabelsOffset);
+    float *embeddingData = reinterpret_cast<float *>(base + header.embeddingsOffset);
+    for (size_t row = 0; row < embeddings.size(); ++row) {
+        if (rowLabels[row] < 0 || rowLabels[row] >= static_cast<int>(labels.size())) {
+            throw std::logic_error("Gallery row " + std::to_string(row) + " has no valid label");
+        }
+        rowLabelData[row] = static_cast<uint32_t>(rowLabels[row]);
+        std::copy(embeddings[row].begin(), embeddings[row].end(), embeddingData + row * dimension);
+    }
+
+    gallery->_base = base;
+    gallery->_size = header.size;
+    gallery->validate();
+    return gallery;
+}
+
+std::shared_ptr<const Gallery> Gallery::copy(const Gallery &source, int node, HugePages hugePages) {
+    const size_t size = source.header().size;
+    void *memory = allocateNodeMemory(size, node, hugePages);
+    if (!memory) {
+        throw std::logic_error("Cannot allocate " + std::to_string(size) + " bytes for a gallery copy");
+    }
+    std::memcpy(memory, source.data(), size);
+
+    std::shared_ptr<Gallery> gallery(new Gallery());
+    gallery->_base = static_cast<const unsigned char *>(memory);
+    gallery->_size = size;
+    gallery->_nodeMemory = true;
+    gallery->_hugePages = hugePages;
+    return gallery;
+}
+
+std::shared_ptr<const Gallery> Gallery::map(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::logic_error("Cannot open gallery " + path);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(GalleryHeader))) {
+        close(fd);
+        throw std::logic_error("Gallery " + path + " is truncated");
+    }
+    void *base = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw std::logic_error("Cannot map gallery " + path);
+    }
+
+    std::shared_ptr<Gallery> gallery(new Gallery());
+    gallery->_base = static_cast<const unsigned char *>(base);
+    gallery->_size = status.st_size;
+    gallery->_mapped = true;
+    gallery->validate();
+
+    slog::info << "Gallery " << path << " mapped: " << gallery->size() << " embeddings of "
+               << gallery->dimension() << " values, " << gallery->labelCount() << " labels" << slog::endl;
+    return gallery;
+}
+
+void Gallery::save(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(_base), header().size);
+    if (!file) {
+        throw std::logic_error("Cannot write gallery " + path);
+    }
+}
+
+void Gallery::validate() const {
+    const GalleryHeader &galleryHeader = header();
+    if (galleryHeader.magic != GALLERY_MAGIC || galleryHeader.version != GALLERY_VERSION) {
+        throw std::logic_error("Unsupported gallery format");
+    }
+    if (galleryHeader.size > _size ||
+        galleryHeader.labelsOffset + uint64_t(galleryHeader.labelCount) * GALLERY_LABEL_SIZE > galleryHeader.size ||
+        galleryHeader.rowLabelsOffset + uint64_t(galleryHeader.count) * sizeof(uint32_t) > galleryHeader.size ||
+        galleryHeader.embeddingsOffset + uint64_t(galleryHeader.count) * galleryHeader.dimension * sizeof(float) > galleryHeader.size) {
+        throw std::logic_error("Gallery is truncated");
+    }
+    for (int row = 0; row < size(); ++row) {
+        if (static_cast<uint32_t>(rowLabel(row)) >= galleryHeader.labelCount) {
+            throw std::logic_error("Gallery row " + std::to_string(row) + " has no valid label");
+        }
+    }
+}
+
+const GalleryHeader &Gallery::header() const {
+    return *reinterpret_cast<const GalleryHeader *>(_base);
+}
+
+const unsigned char *Gallery::data() const {
+    return _base;
+}
+
+HugePages Gallery::hugePages() const {
+    return _hugePages;
+}
+
+int Gallery::dimension() const {
+    return header().dimension;
+}
+
+int Gallery::size() const {
+    return header().count;
+}
+
+int Gallery::labelCount() const {
+    return header().labelCount;
+}
+
+uint64_t Gallery::embeddingModel() const {
+    return header().embeddingModel;
+}
+
+bool Gallery::enrolledWith(const std::string &featureExtractionModel) const {
+    return embeddingModel() != 0 && embeddingModel() == modelHash(featureExtractionModel);
+}
+
+const float *Gallery::embeddings() const {
+    return reinterpret_cast<const float *>(_base + header().embeddingsOffset);
+}
+
+const float *Gallery::embedding(int row) const {
+    return embeddings() + size_t(row) * dimension();
+}
+
+std::string Gallery::label(int index) const {
+    const char *name = labelData(index);
+    return std::string(name, strnlen(name, GALLERY_LABEL_SIZE));
+}
+
+const char *Gallery::labelData(int index) const {
+    return reinterpret_cast<const char *>(_base + header().labelsOffset + index * GALLERY_LABEL_SIZE);
+}
+
+int Gallery::rowLabel(int row) const {
+    return reinterpret_cast<const uint32_t *>(_base + header().rowLabelsOffset)[row];
+}
@@ -0,0 +1,97 @@
+#include <algorithm>
+
+#include <samples/slog.hpp>
+
+#include "gallery_replicas.hpp"
+#include "node_memory.hpp"
+
+double GalleryReplicas::NodeBandwidth::gigabytesPerSecond() const {
+    return milliseconds > 0 ? bytes / (milliseconds * 1e6) : 0.0;
+}
+
+GalleryReplicas::GalleryReplicas(std::shared_ptr<const Gallery> gallery, GalleryPlacement placement,
+                                 HugePages hugePages)
+    : _placement(placement), _hugePages(hugePages), _countTlbMisses(false) {
+    const int nodes = nodeCount();
+    switch (placement) {
+    case GalleryPlacement::Local:
+        _replicas.push_back(hugePages == HugePages::None ? gallery : Gallery::copy(*gallery, ANY_NODE, hugePages));
+        break;
+    case GalleryPlacement::Interleaved:
+        _replicas.push_back(Gallery::copy(*gallery, INTERLEAVED_NODES, hugePages));
+        break;
+    case GalleryPlacement::Replicated:
+        for (int node = 0; node < nodes; ++node) {
+            _replicas.push_back(Gallery::copy(*gallery, node, hugePages));
+        }
+        break;
+    }
+    for (int node = 0; node < nodes; ++node) {
+        _counters.emplace_back(new Counters());
+    }
+
+    if (placement != GalleryPlacement::Local) {
+        slog::info << "Gallery of " << gallery->header().size / 1024 << " KB "
+                   << (placement == GalleryPlacement::Interleaved ? "interleaved over " : "replicated on ")
+                   << nodes << " NUMA nodes" << slog::endl;
+    }
+}
+
+const Gallery &GalleryReplicas::local(int &node) const {
+    node = std::min(currentNode(), nodes() - 1);
+    return replica(node);
+}
+
+void GalleryReplicas::recordScan(int node, uint64_t bytes, double milliseconds, uint64_t tlbMisses) {
+    Counters &counters = *_counters.at(node);
+    ++counters.scans;
+    counters.bytes += bytes;
+    counters.nanoseconds += static_cast<uint64_t>(milliseconds * 1e6);
+    counters.tlbMisses += tlbMisses;
+}
+
+void GalleryReplicas::countTlbMisses(bool enabled) {
+    _countTlbMisses = enabled;
+}
+
+bool GalleryReplicas::countsTlbMisses() const {
+    return _countTlbMisses;
+}
+
+GalleryPlacement GalleryReplicas::placement() const {
+    return _placement;
+}
+
+HugePages GalleryReplicas::hugePages() const {
+    return _hugePages;
+}
+
+int GalleryReplicas::nodes() const {
+    return static_cast<int>(_counters.size());
+}
+
+const Gallery &GalleryReplicas::replica(int node) const {
+    return *_replicas[_replicas.size() == 1 ? 0 : node];
+}
+
+std::vector<GalleryReplicas::NodeBandwidth> GalleryReplicas::bandwidth() const {
+    std::vector<NodeBandwidth> nodeBandwidth;
+    for (auto &counters : _counters) {
+        NodeBandwidth node;
+        node.scans = counters->scans;
+        node.bytes = counters->bytes;
+        node.milliseconds = counters->nanoseconds / 1e6;
+        node.tlbMisses = counters->tlbMisses;
+        nodeBandwidth.push_back(node);
+    }
+    return nodeBandwidth;
+}
+
+void GalleryReplicas::resetBandwidth() {
+    for (auto &counters : _counters) {
+        counters->scans = 0;
+        counters->bytes = 0;
+        counters->nanoseconds = 0;
+        counters->tlbMisses = 0;
+    }
+}
@@ -8,6 +8,7 @@
 * \example interactive_face_detection_demo/main.cpp
 */
 #include <cstdlib>
+#include <cstring>
 
 #include <functional>
 #include <iostream>
@@ -21,6 +22,8 @@
 #include <algorithm>
 #include <iterator>
 #include <map>
+#include <sstream>
+#include <mutex>
 
 #include <inference_engine.hpp>
 
@@ -30,20 +33,41 @@
 #include <ie_iextension.h>
 #include <ext_list.hpp>
 
-#include "utility.hpp"
-#include "detectors.hpp"
-#include "alignment.hpp"
-#include "feature_extractor.hpp"
-#include "classifier.hpp"
+#include "allocation_tracker.hpp"
+#include "engine.hpp"
+#include "sharded_engine.hpp"
+#include "shared_ring.hpp"
+
+// Output of the recognitions issued through one session handle. Sessions of one engine
+// may be used from different threads concurrently, a single session from one thread at a time.
+// Stream sessions of a sharded engine are served by the shard of their stream.
+struct RecognitionSession {
+    FaceRecognitionEngine *engine;
+    ShardedEngine *shardedEngine;
+    std::string stream;
+    RecognitionResult recognition;
+
+    explicit RecognitionSession(FaceRecognitionEngine &engine) : engine(&engine), shardedEngine(nullptr) {}
+    RecognitionSession(ShardedEngine &shardedEngine, const std::string &stream)
+        : engine(nullptr), shardedEngine(&shardedEngine), stream(stream) {}
+
+    void recognize(const cv::Mat &image, cv::Mat &detectedFacesImage, cv::Mat &recognizedFacesImage,
+                   const FrameOptions &options = FrameOptions()) {
+        if (shardedEngine) {
+            shardedEngine->recognize(stream, image, detectedFacesImage, recognizedFacesImage, recognition, options);
+        } else {
+            engine->recognize(image, detectedFacesImage, recognizedFacesImage, recognition, options);
+        }
+    }
+};
 
-//Switch to singletone
-Timer timer;
-std::vector<cv::Mat> alignedFaces;
-std::vector<cv::Mat> detectedFaces;
+// Engine and output of the legacy API, which is not reentrant
+std::unique_ptr<FaceRecognitionEngine> engine;
+std::once_flag engineCreated;
+RecognitionResult lastRecognition;
 
-std::string faceDetectionModel = "models/face-detection-adas-0001.xml";
-std::string facialLandmarksModel = "models/facial-landmarks-35-adas-0001.xml";
-std::string featureExtractionModel = "models/Sphereface.xml";
+SharedRing sharedRing;
+std::vector<RecognitionResult> ringRecognitions;
 
 using namespace InferenceEngine;
 
@@ -57,22 +81,387 @@ std::string retrievePath(int argc, char *argv[]) {
     return "";
 }
 
+static FaceRecognitionEngine &defaultEngine() {
+    std::call_once(engineCreated, [] { engine.reset(new FaceRecognitionEngine()); });
+    return *engine;
+}
+
+// --------------------------- Engine and session handles -------------------------------------------------
+
+// Null model paths and device select the defaults of EngineConfig. Returns null on failure.
+extern "C" void* createEngine(const char* faceDetectionModel, const char* facialLandmarksModel,
+                              const char* featureExtractionModel, const char* deviceName, int inferRequests) {
+    try {
+        EngineConfig config;
+        if (faceDetectionModel) config.faceDetectionModel = faceDetectionModel;
+        if (facialLandmarksModel) config.facialLandmarksModel = facialLandmarksModel;
+        if (featureExtractionModel) config.featureExtractionModel = featureExtractionModel;
+        if (deviceName) config.deviceName = deviceName;
+        if (inferRequests > 0) config.inferRequests = inferRequests;
+        return new FaceRecognitionEngine(config);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return nullptr;
+    }
+}
+
+// Applies comma separated key=value options, e.g. "inferRequests=16,detectionBatch=16".
+static void applyEngineOptions(EngineConfig &config, const std::string &options) {
+    std::istringstream stream(options);
+    std::string option;
+    while (std::getline(stream, option, ',')) {
+        if (option.empty()) continue;
+        const size_t separator = option.find('=');
+        if (separator == std::string::npos) {
+            throw std::logic_error("Engine option " + option + " has no value");
+        }
+        const std::string key = option.substr(0, separator);
+        const std::string value = option.substr(separator + 1);
+        if (key == "inferRequests") config.inferRequests = std::stoi(value);
+        else if (key == "cpuThreads") config.cpuThreads = std::stoi(value);
+        else if (key == "inferenceThreads") config.inferenceThreads = std::stoi(value);
+        else if (key == "maxFacesPerFrame") config.maxFacesPerFrame = std::stoi(value);
+        else if (key == "detectionThreshold") config.detectionThreshold = std::stod(value);
+        else if (key == "detectionBatch") config.detectionBatch = std::stoi(value);
+        else if (key == "detectionWindow") config.detectionWindow = std::stod(value);
+        else if (key == "detectionQueue") config.detectionQueue = std::stoi(value);
+        else if (key == "reservedInteractiveRequests") config.reservedInteractiveRequests = std::stoi(value);
+        else if (key == "maxQueuedFrames") config.maxQueuedFrames = std::stoi(value);
+        else if (key == "embeddingBatch") config.embeddingBatch = std::stoi(value);
+        else if (key == "embeddingDeadline") config.embeddingDeadline = std::stod(value);
+        else if (key == "embeddingQueue") config.embeddingQueue = std::stoi(value);
+        else if (key == "parallelLoading") config.parallelLoading = std::stoi(value) != 0;
+        else if (key == "lazyLoading") config.lazyLoading = std::stoi(value) != 0;
+        else if (key == "warmUpInferences") config.warmUpInferences = std::stoi(value);
+        else if (key == "networkCache") config.networkCache = value;
+        else throw std::logic_error("Unknown engine option " + key);
+    }
+}
+
+// Like createEngine, with the rest of EngineConfig given as options (see applyEngineOptions).
+extern "C" void* createEngineWithOptions(const char* faceDetectionModel, const char* facialLandmarksModel,
+                                         const char* featureExtractionModel, const char* deviceName,
+                                         const char* options) {
+    try {
+        EngineConfig config;
+        if (faceDetectionModel) config.faceDetectionModel = faceDetectionModel;
+        if (facialLandmarksModel) config.facialLandmarksModel = facialLandmarksModel;
+        if (featureExtractionModel) config.featureExtractionModel = featureExtractionModel;
+        if (deviceName) config.deviceName = deviceName;
+        if (options) applyEngineOptions(config, options);
+        return new FaceRecognitionEngine(config);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return nullptr;
+    }
+}
+
+// Batched face detections so far: number of inferences and of frames they detected.
+extern "C" void getEngineDetectionStats(void* engineHandle, unsigned long long* batches, unsigned long long* frames) {
+    const DetectionBatcher::Stats stats = static_cast<FaceRecognitionEngine*>(engineHandle)->detectionStats();
+    *batches = stats.batches;
+    *frames = stats.frames;
+}
+
+// Batched embeddings so far: number of inferences, faces embedded by them and inferences of a full batch.
+// Returns the batch size, the fill rate is faces / (batches * batch size).
+extern "C" int getEngineEmbeddingStats(void* engineHandle, unsigned long long* batches, unsigned long long* faces,
+                                       unsigned long long* fullBatches) {
+    FaceRecognitionEngine &engine = *static_cast<FaceRecognitionEngine*>(engineHandle);
+    const EmbeddingBatcher::Stats stats = engine.embeddingStats();
+    *batches = stats.batches;
+    *faces = stats.faces;
+    *fullBatches = stats.fullBatches;
+    return std::max(1, engine.config().embeddingBatch);
+}
+
+static void copySchedulingStats(const SchedulingStats &stats, unsigned long long* counters) {
+    counters[0] = stats.recognized;
+    counters[1] = stats.expired;
+    counters[2] = stats.shed;
+    counters[3] = stats.reverificationsDropped;
+}
+
+// Fills up to maxQueues queues between the stages, see FaceRecognitionEngine::queueStats(), and
+// returns their number. names receives nameSize byte zero padded names, counters 7 values per
+// queue: capacity (0 is unbounded), depth, high water mark, pushed, popped, dropped, blocked.
+extern "C" int getEngineQueueStats(void* engineHandle, char* names, int nameSize, unsigned long long* counters,
+                                   int maxQueues) {
+    if (!engineHandle || nameSize <= 0) return -1;
+    const std::vector<QueueStats> queues = static_cast<FaceRecognitionEngine*>(engineHandle)->queueStats();
+    for (int i = 0; i < std::min<int>(maxQueues, queues.size()); ++i) {
+        const QueueStats &queue = queues[i];
+        if (names) {
+            std::memset(names + i * nameSize, 0, nameSize);
+            std::strncpy(names + i * nameSize, queue.name.c_str(), nameSize - 1);
+        }
+        if (counters) {
+            unsigned long long *values = counters + i * 7;
+            values[0] = queue.capacity;
+            values[1] = queue.depth;
+            values[2] = queue.highWater;
+            values[3] = queue.pushed;
+            values[4] = queue.popped;
+            values[5] = queue.dropped;
+            values[6] = queue.blocked;
+        }
+    }
+    return static_cast<int>(queues.size());
+}
+
+// Frame counters: recognized, expired, shed and re-verifications among the dropped ones.
+extern "C" void getEngineSchedulingStats(void* engineHandle, unsigned long long* counters) {
+    copySchedulingStats(static_cast<FaceRecognitionEngine*>(engineHandle)->schedulingStats(), counters);
+}
+
+extern "C" void getShardedEngineSchedulingStats(void* shardedEngineHandle, unsigned long long* counters) {
+    copySchedulingStats(static_cast<ShardedEngine*>(shardedEngineHandle)->schedulingStats(), counters);
+}
+
+// Cold start in milliseconds: plugin, face detection, facial landmarks and feature extraction
+// networks, all networks, time to the first recognized frame (0 before it), and warm-up
+// inferences. durations holds 7 values; warm-up comes last, after the fields of earlier releases.
+extern "C" void getEngineStartupStats(void* engineHandle, double* durations) {
+    const StartupStats stats = static_cast<FaceRecognitionEngine*>(engineHandle)->startupStats();
+    durations[0] = stats.plugin;
+    durations[1] = stats.faceDetection;
+    durations[2] = stats.facialLandmarks;
+    durations[3] = stats.featureExtraction;
+    durations[4] = stats.models;
+    durations[5] = stats.firstFrame;
+    durations[6] = stats.warmUp;
+}
+
+// Swaps the network of model (1 face detection, 2 facial landmarks, 4 feature extraction) for
+// the one of modelPath while the engine serves, see FaceRecognitionEngine::swapModel. A feature
+// extraction network requires the gallery file enrolled with it. Returns 0, or -1 when the
+// swap is refused or fails and the current network is kept.
+extern "C" int swapEngineModel(void* engineHandle, int model, const char* modelPath, const char* galleryPath) {
+    if (!engineHandle || !modelPath) return -1;
+    try {
+        std::shared_ptr<const Gallery> gallery = galleryPath ? Gallery::map(galleryPath) : nullptr;
+        static_cast<FaceRecognitionEngine*>(engineHandle)->swapModel(static_cast<EngineModels>(model), modelPath,
+                                                                      gallery);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Embeds count faces, faceData[i] being a rows[i] x cols[i] BGR image (best an aligned face), with
+// the current feature extraction network of the engine and saves their gallery to galleryPath,
+// stamped so that swapEngineModel() accepts it with that network. faceLabels[i] indexes the
+// labelCount labels. Returns 0, or -1 on failure.
+extern "C" int enrollEngineGallery(void* engineHandle, const char* galleryPath, unsigned char** faceData,
+                                   const int* rows, const int* cols, const int* faceLabels, int count,
+                                   const char** labels, int labelCount) {
+    if (!engineHandle || !galleryPath || count < 0 || labelCount < 0) return -1;
+    try {
+        std::vector<cv::Mat> faces;
+        std::vector<int> rowLabels(faceLabels, faceLabels + count);
+        for (int i = 0; i < count; ++i) {
+            if (faceLabels[i] < 0 || faceLabels[i] >= labelCount) {
+                throw std::logic_error("Face " + std::to_string(i) + " has no label");
+            }
+            faces.emplace_back(rows[i], cols[i], CV_8UC3, faceData[i]);
+        }
+        const std::vector<std::string> names(labels, labels + labelCount);
+        static_cast<FaceRecognitionEngine*>(engineHandle)->enroll(names, rowLabels, faces)->save(galleryPath);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// All sessions of the engine shall be destroyed before.
+extern "C" void destroyEngine(void* engineHandle) {
+    delete static_cast<FaceRecognitionEngine*>(engineHandle);
+}
+
+extern "C" void* createSession(void* engineHandle) {
+    if (!engineHandle) return nullptr;
+    return new RecognitionSession(*static_cast<FaceRecognitionEngine*>(engineHandle));
+}
+
+// Null model paths and device select the defaults of EngineConfig, shards <= 0 makes one shard
+// per NUMA node and a null gallery path selects the built-in gallery. galleryPlacement is
+// 0 for local, 1 for interleaved and 2 for per node replicas. options configure the shard
+// engines as in createEngineWithOptions and may be null. Returns null on failure.
+extern "C" void* createShardedEngine(const char* faceDetectionModel, const char* facialLandmarksModel,
+                                     const char* featureExtractionModel, const char* deviceName,
+                                     int shards, const char* galleryPath, int galleryPlacement, const char* options) {
+    try {
+        ShardedEngineConfig config;
+        if (faceDetectionModel) config.engine.faceDetectionModel = faceDetectionModel;
+        if (facialLandmarksModel) config.engine.facialLandmarksModel = facialLandmarksModel;
+        if (featureExtractionModel) config.engine.featureExtractionModel = featureExtractionModel;
+        if (deviceName) config.engine.deviceName = deviceName;
+        if (options) applyEngineOptions(config.engine, options);
+        if (galleryPath) config.galleryPath = galleryPath;
+        config.shards = shards;
+        switch (galleryPlacement) {
+        case 0: config.galleryPlacement = GalleryPlacement::Local; break;
+        case 1: config.galleryPlacement = GalleryPlacement::Interleaved; break;
+        default: config.galleryPlacement = GalleryPlacement::Replicated; break;
+        }
+        return new ShardedEngine(config);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return nullptr;
+    }
+}
+
+// All stream sessions of the engine shall be destroyed before.
+extern "C" void destroyShardedEngine(void* shardedEngineHandle) {
+    delete static_cast<ShardedEngine*>(shardedEngineHandle);
+}
+
+// Fills up to maxNodes gallery scan counters, indexed by the NUMA node of the scanning
+// threads, and returns the number of nodes. Any of the arrays may be null.
+static int getGalleryBandwidth(const GalleryReplicas &replicas, unsigned long long* scans, unsigned long long* bytes,
+                               double* milliseconds, unsigned long long* tlbMisses, int maxNodes) {
+    std::vector<GalleryReplicas::NodeBandwidth> bandwidth = replicas.bandwidth();
+    for (int node = 0; node < std::min<int>(maxNodes, bandwidth.size()); ++node) {
+        if (scans) scans[node] = bandwidth[node].scans;
+        if (bytes) bytes[node] = bandwidth[node].bytes;
+        if (milliseconds) milliseconds[node] = bandwidth[node].milliseconds;
+        if (tlbMisses) tlbMisses[node] = bandwidth[node].tlbMisses;
+    }
+    return static_cast<int>(bandwidth.size());
+}
+
+extern "C" int getEngineGalleryBandwidth(void* engineHandle, unsigned long long* scans, unsigned long long* bytes,
+                                         double* milliseconds, unsigned long long* tlbMisses, int maxNodes) {
+    if (!engineHandle) return -1;
+    return getGalleryBandwidth(*static_cast<FaceRecognitionEngine*>(engineHandle)->galleryReplicas(),
+                               scans, bytes, milliseconds, tlbMisses, maxNodes);
+}
+
+extern "C" int getShardedEngineGalleryBandwidth(void* shardedEngineHandle, unsigned long long* scans,
+                                                unsigned long long* bytes, double* milliseconds,
+                                                unsigned long long* tlbMisses, int maxNodes) {
+    if (!shardedEngineHandle) return -1;
+    return getGalleryBandwidth(*static_cast<ShardedEngine*>(shardedEngineHandle)->galleryReplicas(),
+                               scans, bytes, milliseconds, tlbMisses, maxNodes);
+}
+
+extern "C" void* createStreamSession(void* shardedEngineHandle, const char* stream) {
+    if (!shardedEngineHandle || !stream) return nullptr;
+    return new RecognitionSession(*static_cast<ShardedEngine*>(shardedEngineHandle), stream);
+}
+
+extern "C" void destroySession(void* sessionHandle) {
+    delete static_cast<RecognitionSession*>(sessionHandle);
+}
+
+extern "C" int recognizeFacesInSession(void* sessionHandle, unsigned char* sourceImageData, int rows, int cols,
+                                       unsigned char* detectionImageData, unsigned char* recognizedImageData) {
+    RecognitionSession &session = *static_cast<RecognitionSession*>(sessionHandle);
+    try {
+        cv::Mat image(rows, cols, CV_8UC3, sourceImageData);
+        cv::Mat detectedFacesImage(rows, cols, CV_8UC3, detectionImageData);
+        cv::Mat recognizedFacesImage(rows, cols, CV_8UC3, recognizedImageData);
+        session.recognize(image, detectedFacesImage, recognizedFacesImage);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Like recognizeFacesInSession, the frame is dropped unless it can be recognized within deadlineMilliseconds
+// (<= 0 for no deadline). priority is 0 for bulk, 1 for normal and 2 for interactive frames.
+// reverification marks frames of a track which is already identified, which are served after
+// fresh ones of their class. Returns 1 when the frame was dropped.
+extern "C" int recognizeFacesInSessionWithDeadline(void* sessionHandle, unsigned char* sourceImageData, int rows, int cols,
+                                                   unsigned char* detectionImageData, unsigned char* recognizedImageData,
+                                                   double deadlineMilliseconds, int priority, int reverification) {
+    RecognitionSession &session = *static_cast<RecognitionSession*>(sessionHandle);
+    try {
+        FrameOptions options;
+        if (deadlineMilliseconds > 0) {
+            options.deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(deadlineMilliseconds));
+        }
+        options.priority = priority <= 0 ? FramePriority::Bulk :
+                           priority == 1 ? FramePriority::Normal : FramePriority::Interactive;
+        options.reverification = reverification != 0;
+        cv::Mat image(rows, cols, CV_8UC3, sourceImageData);
+        cv::Mat detectedFacesImage(rows, cols, CV_8UC3, detectionImageData);
+        cv::Mat recognizedFacesImage(rows, cols, CV_8UC3, recognizedImageData);
+        session.recognize(image, detectedFacesImage, recognizedFacesImage, options);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return -1;
+    }
+    return session.recognition.dropped ? 1 : 0;
+}
+
+extern "C" double getSessionRecognitionTime(void* sessionHandle) {
+    return static_cast<RecognitionSession*>(sessionHandle)->recognition.recognitionTime;
+}
+
+// Copies up to maxFaces face rectangles (x, y, width, height) and returns the number of faces.
+extern "C" int getSessionFaces(void* sessionHandle, int* rects, int maxFaces) {
+    const RecognitionResult &recognition = static_cast<RecognitionSession*>(sessionHandle)->recognition;
+    const int count = static_cast<int>(recognition.detections.size());
+    for (int i = 0; i < std::min(count, maxFaces); ++i) {
+        const cv::Rect &location = recognition.detections[i].location;
+        rects[4 * i + 0] = location.x;
+        rects[4 * i + 1] = location.y;
+        rects[4 * i + 2] = location.width;
+        rects[4 * i + 3] = location.height;
+    }
+    return count;
+}
+
+// Label of the i-th face, valid until the next recognition in the session.
+extern "C" const char* getSessionFaceLabel(void* sessionHandle, int index) {
+    const RecognitionResult &recognition = static_cast<RecognitionSession*>(sessionHandle)->recognition;
+    if (index < 0 || index >= static_cast<int>(recognition.persons.size())) return "";
+    return recognition.persons[index].c_str();
+}
+
+extern "C" int getSessionAlignedFacesArena(void* sessionHandle, const unsigned char** data, const AlignedFaceRecord** table,
+                                           unsigned int* slotRows, unsigned int* slotCols) {
+    const AlignedFaceArena &arena = static_cast<RecognitionSession*>(sessionHandle)->recognition.alignedArena;
+    *data = arena.data();
+    *table = arena.table().data();
+    *slotRows = arena.faceSize().height;
+    *slotCols = arena.faceSize().width;
+    return arena.size();
+}
+
+extern "C" void clearSession(void* sessionHandle) {
+    static_cast<RecognitionSession*>(sessionHandle)->recognition.clear();
+}
+
+// --------------------------- Legacy API on the default session ------------------------------------------
+
 extern "C" void clear() {
-    alignedFaces.clear();
-    detectedFaces.clear();
+    lastRecognition.clear();
 }
 
 
 extern "C" double getFaceRecognitionTime() {
-    return timer["total"].getSmoothedDuration();
+    return lastRecognition.recognitionTime;
 }
 
 extern "C" int getAlignedFacesCount() {
-     return alignedFaces.size();
+     return lastRecognition.alignedFaces.size();
 }
 
 extern "C" void getAlignedFacesSizes(unsigned int* widthData, unsigned int* heightData) {
-    for (auto alignedFace : alignedFaces) {
+    for (auto alignedFace : lastRecognition.alignedFaces) {
         *widthData = alignedFace.size().width;
         *heightData = alignedFace.size().height;
 
@@ -82,7 +471,7 @@ extern "C" void getAlignedFacesSizes(unsigned int* widthData, unsigned int* heig
 }
 
 extern "C" void getAlignedFaces(unsigned char* alignedImagesData) {
-    for (auto alignedFace : alignedFaces) {
+    for (auto alignedFace : lastRecognition.alignedFaces) {
         auto width = alignedFace.size().width;
         auto height = alignedFace.size().height;
 
@@ -93,8 +482,20 @@ extern "C" void getAlignedFaces(unsigned char* alignedImagesData) {
     }
 }
 
+// Aligned faces as one contiguous buffer of fixed size slots, valid until the next recognition or clear().
+// Returns the number of slots; the table holds the offset and shape of every slot (rows == 0 when empty).
+extern "C" int getAlignedFacesArena(const unsigned char** data, const AlignedFaceRecord** table,
+                                    unsigned int* slotRows, unsigned int* slotCols) {
+    const AlignedFaceArena &arena = lastRecognition.alignedArena;
+    *data = arena.data();
+    *table = arena.table().data();
+    *slotRows = arena.faceSize().height;
+    *slotCols = arena.faceSize().width;
+    return arena.size();
+}
+
 extern "C" void getDetectedFaces(unsigned char* detectedImagesData) {
-    for (auto detectedFace : detectedFaces) {
+    for (auto detectedFace : lastRecognition.detectedFaces) {
         auto width = detectedFace.size().width;
         auto height = detectedFace.size().height;
 
@@ -106,199 +507,177 @@ extern "C" void getDetectedFaces(unsigned char* detectedImagesData) {
 }
 extern "C" void recognizeFaces(unsigned char* sourceImageData, int rows, int cols, unsigned char* detectionImageData, unsigned char* recognizedImageData) {
     cv::Mat image(rows, cols, CV_8UC3, sourceImageData);
+    cv::Mat detectedFacesImage(rows, cols, CV_8UC3, detectionImageData);
+    cv::Mat recognizedFacesImage(rows, cols, CV_8UC3, recognizedImageData);
 
-    auto size = image.size();
-    const size_t width = size.width;
-    const size_t height = size.height;
-
-    // ---------------------------------------------------------------------------------------------------
-    // --------------------------- 1. Loading plugin to the Inference Engine -----------------------------
-    std::string deviceName = "CPU";
-    std::map<std::string, InferencePlugin> pluginsForDevices;
-
-    FaceDetection faceDetector(faceDetectionModel, deviceName, 1, false, false, 0.5, false);
-    FacialLandmarksDetection facialLandmarksDetector(facialLandmarksModel, deviceName, 16, false, false);
-    FeatureExtraction featureExtractor(featureExtractionModel, deviceName, 1, false, false);
-    Classification classifier;
-
-    InferencePlugin plugin = PluginDispatcher({"../../../lib/intel64", ""}).getPluginByDevice(deviceName);
-    plugin.AddExtension(std::make_shared<Extensions::Cpu::CpuExtensions>());
-    pluginsForDevices[deviceName] = plugin;
-
-    // ---------------------------------------------------------------------------------------------------
+    defaultEngine().recognize(image, detectedFacesImage, recognizedFacesImage, lastRecognition);
+}
 
-    // --------------------------- 2. Reading IR models and loading them to plugins ----------------------
-    // Disable dynamic batching for face detector as it processes one image at a time
-    // Disable dynamic batching for feature extractor for prototype
-    Load<decltype(faceDetector)>(faceDetector).into(pluginsForDevices[deviceName], false);
-    Load<decltype(facialLandmarksDetector)>(facialLandmarksDetector).into(pluginsForDevices[deviceName], false);
-    Load<decltype(featureExtractor)>(featureExtractor).into(pluginsForDevices[deviceName], false);
-    // ----------------------------------------------------------------------------------------------------
+// --------------------------- Shared memory ring ---------------------------------------------------------
+// Frames are written in place by the client into a frame slot, results are written by the engine into
+// the matching result slot and stay valid until the client calls releaseSlot().
 
-    // --------------------------- 3. Doing inference -----------------------------------------------------
-    // Starting inference & calculating performance
+extern "C" int createSharedRing(const char* name, int slotCount, int maxRows, int maxCols, int maxFaces) {
+    try {
+        sharedRing.create(name, slotCount, maxRows, maxCols, maxFaces);
+        ringRecognitions.clear();
+        ringRecognitions.resize(slotCount);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return -1;
+    }
+    return 0;
+}
 
-    bool isFaceAnalyticsEnabled = facialLandmarksDetector.enabled();
+extern "C" void destroySharedRing() {
+    sharedRing.destroy();
+}
 
-    timer.start("total");
+extern "C" int acquireSlot() {
+    return sharedRing.isOpen() ? sharedRing.acquire() : -1;
+}
 
-    std::ostringstream out;
+extern "C" void releaseSlot(int slot) {
+    try {
+        sharedRing.release(slot);
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+    }
+}
 
-    {
-        // Detecting all faces on the first frame and reading the next one
-        timer.start("detection");
-        faceDetector.enqueue(image);
-        faceDetector.submitRequest();
-        faceDetector.wait();
-        faceDetector.fetchResults();
-        auto detectionResults = faceDetector.results;
-        timer.finish("detection");
-
-
-        timer.start("data postprocessing");
-        // Filling inputs of face analytics networks
-        for (auto &&face : detectionResults) {
-            if (isFaceAnalyticsEnabled) {
-                auto clippedRect = face.location & cv::Rect(0, 0, width, height);
-                cv::Mat face = image(clippedRect);
-                detectedFaces.push_back(face);
-                facialLandmarksDetector.enqueue(face);
+extern "C" int recognizeFacesInSlot(int slot, int rows, int cols) {
+    try {
+        cv::Mat image = sharedRing.frame(slot, rows, cols);
+        cv::Mat detectedFacesImage = sharedRing.detectionImage(slot, rows, cols);
+        cv::Mat recognizedFacesImage = sharedRing.recognitionImage(slot, rows, cols);
+
+        RecognitionResult &recognition = ringRecognitions.at(slot);
+        defaultEngine().recognize(image, detectedFacesImage, recognizedFacesImage, recognition);
+        const auto &detectionResults = recognition.detections;
+        const auto &persons = recognition.persons;
+        const auto &alignedArena = recognition.alignedArena;
+        const auto &alignedTable = alignedArena.table();
+
+        SharedResultHeader &result = sharedRing.result(slot);
+        SharedFaceRecord *faces = sharedRing.faces(slot);
+        unsigned char *alignedData = sharedRing.alignedFaces(slot);
+        const size_t maxFaces = sharedRing.header().maxFaces;
+        // The result header is only written, the client may change it meanwhile
+        const size_t faceCount = std::min(detectionResults.size(), maxFaces);
+
+        result.rows = rows;
+        result.cols = cols;
+        result.faceCount = faceCount;
+        result.recognitionTime = recognition.recognitionTime;
+
+        // The arena slots are contiguous, so all aligned faces move with a single copy
+        const size_t alignedSlots = std::min<size_t>(alignedTable.size(), sharedRing.alignedCapacity() / alignedArena.slotBytes());
+        result.truncated = alignedTable.size() - alignedSlots;
+        std::memcpy(alignedData, alignedArena.data(), alignedSlots * alignedArena.slotBytes());
+
+        for (size_t i = 0; i < faceCount; ++i) {
+            SharedFaceRecord &face = faces[i];
+            const cv::Rect &location = detectionResults[i].location;
+            face.x = location.x;
+            face.y = location.y;
+            face.width = location.width;
+            face.height = location.height;
+            face.alignedRows = 0;
+            face.alignedCols = 0;
+            face.alignedOffset = 0;
+            std::memset(face.label, 0, sizeof(face.label));
+            if (i < persons.size()) {
+                persons[i].copy(face.label, sizeof(face.label) - 1);
             }
-        }
-        timer.finish("data postprocessing");
 
-        // Running Facial Landmarks Estimation network
-        timer.start("facial landmarks detector");
-        if (isFaceAnalyticsEnabled) {
-            facialLandmarksDetector.submitRequest();
-            facialLandmarksDetector.wait();
-        }
-        timer.finish("facial landmarks detector");
-
-        timer.start("face preprocessing");
-        if (isFaceAnalyticsEnabled) {
-            int i = 0;
-            for (auto &result : detectionResults) {
-                cv::Rect rect = result.location;
-                auto normedLandmarks = facialLandmarksDetector[i];
-                auto leftEye = { cv::Point2f { normedLandmarks[0], normedLandmarks[1] },
-                                  cv::Point2f { normedLandmarks[2], normedLandmarks[3] } };
-                auto rightEye = { cv::Point2f { normedLandmarks[4], normedLandmarks[5] },
-                                   cv::Point2f { normedLandmarks[6], normedLandmarks[7] } };
-                cv::Mat alignedFace = alignFace(detectedFaces[i], leftEye, rightEye);
-                alignedFaces.push_back(alignedFace); // alignedFaces is temporarily global variable
-
-                if (!alignedFace.empty()) {
-                    featureExtractor.enqueue(alignedFace);
-                }
-
-                ++i;
+            if (i < alignedSlots) {
+                face.alignedRows = alignedTable[i].rows;
+                face.alignedCols = alignedTable[i].cols;
+                face.alignedOffset = alignedTable[i].offset;
             }
         }
-        timer.finish("face preprocessing");
+    }
+    catch (const std::exception& error) {
+        slog::err << error.what() << slog::endl;
+        return -1;
+    }
+    return 0;
+}
 
-        timer.start("feature extractor");
-        std::vector<std::vector<float>> featureVectors;
+// --------------------------- Allocation budget ------------------------------------------------------------
+// Available when the library is built with ENABLE_ALLOCATION_TRACKING, see allocation_tracker.hpp.
 
-        if (isFaceAnalyticsEnabled) {
-            featureExtractor.submitRequest();
-            featureExtractor.wait();
-            featureExtractor.fetchResults();
+extern "C" int allocationTrackingAvailable() {
+    return AllocationTracker::available();
+}
 
-            auto resultsSize = detectionResults.size();
-            for (int i = 0; i < resultsSize; ++i) {
-                featureVectors.push_back(featureExtractor.results);
-            }
-        }
-        timer.finish("feature extractor");
+extern "C" void startAllocationTracking() {
+    AllocationTracker::start();
+}
 
-        timer.start("classifier");
+extern "C" void stopAllocationTracking() {
+    AllocationTracker::stop();
+}
 
-        std::vector<std::string> persons;
-        for (auto featureVector : featureVectors) {
-            auto label = classifier.classify(featureVector);
-            persons.push_back(label);
-        }
-        timer.finish("classifier");
-        timer.finish("total");
-
-        // Visualizing results
-        {
-            timer.start("visualization");
-//            out.str("");
-//            out << "OpenCV render time: " << std::fixed << std::setprecision(2)
-//                <<  timer["visualization"].getSmoothedDuration()
-//                << " ms";
-//            cv::putText(image, out.str(), cv::Point2f(0, 25), cv::FONT_HERSHEY_TRIPLEX, 0.5,
-//                        cv::Scalar(255, 0, 0));
-
-//            out.str("");
-//            out << "Face detection time: " << std::fixed << std::setprecision(2)
-//                << timer["detection"].getSmoothedDuration()
-//                << " ms ("
-//                << 1000.f / (timer["detection"].getSmoothedDuration())
-//                << " fps)";
-//            cv::putText(image, out.str(), cv::Point2f(0, 45), cv::FONT_HERSHEY_TRIPLEX, 0.5,
-//                        cv::Scalar(255, 0, 0));
-
-//            if (isFaceAnalyticsEnabled) {
-//                out.str("");
-//                out << "Facial Landmarks Detector Networks "
-//                    << "time: " << std::fixed << std::setprecision(2)
-//                    << timer["facial landmarks detector"].getSmoothedDuration()
-//                    << " ms ";
-//                if (!detectionResults.empty()) {
-//                    out << "("
-//                        << 1000.f / timer["facial landmarks detector"].getSmoothedDuration()
-//                        << " fps)";
-//                }
-//                cv::putText(image, out.str(), cv::Point2f(0, 65), cv::FONT_HERSHEY_TRIPLEX, 0.5,
-//                            cv::Scalar(255, 0, 0));
-
-//                out.str("");
-//                out << "Face preprocessing before feature extraction "
-//                    << "time: " << std::fixed << std::setprecision(2)
-//                    << timer["face preprocessing"].getSmoothedDuration() +
-//                       timer["face preprocessing"].getSmoothedDuration()
-//                    << " ms ";
-//                cv::putText(image, out.str(), cv::Point2f(0, 85), cv::FONT_HERSHEY_TRIPLEX, 0.5,
-//                            cv::Scalar(255, 0, 0));
-//            }
-
-            // For every detected face
-
-            cv::Mat detectedFaces(rows, cols, CV_8UC3, detectionImageData);
-            image.copyTo(detectedFaces);
-            cv::Mat recognizedFaces(rows, cols, CV_8UC3, recognizedImageData);
-            image.copyTo(recognizedFaces);
-
-            int i = 0;
-            for (auto &result : detectionResults) {
-
-                cv::Rect rect = result.location;
-
-                cv::rectangle(detectedFaces, result.location, cv::Scalar(100, 100, 100), 5);
-                cv::rectangle(recognizedFaces, result.location, cv::Scalar(100, 100, 100), 5);
-
-                out.str("");
-
-
-                out << persons[i];
-                    //Here is detection confidence, but recognition confidence shall be calculated.
-                    //<< ": " << std::fixed << std::setprecision(3) << result.confidence;
-
-
-                cv::putText(recognizedFaces,
-                            out.str(),
-                            cv::Point2f(result.location.x, result.location.y - 15),
-                            cv::FONT_HERSHEY_COMPLEX,
-                            2,
-                            cv::Scalar(0, 0, 255));
-                i++;
-            }
+// Copies up to maxStages stage names (32 bytes each), allocation and byte counts since the
+// last start and returns the number of stages. frames receives the number of recognized frames.
+extern "C" int getAllocationStats(char* names, unsigned long long* allocations, unsigned long long* bytes,
+                                  unsigned long long* frames, int maxStages) {
+    const std::vector<AllocationTracker::StageStats> stages = AllocationTracker::stats();
+    const int count = static_cast<int>(stages.size());
+    for (int i = 0; i < std::min(count, maxStages); ++i) {
+        char *name = names + i * 32;
+        std::memset(name, 0, 32);
+        stages[i].name.copy(name, 31);
+        allocations[i] = stages[i].allocations;
+        bytes[i] = stages[i].bytes;
+    }
+    if (frames) *frames = AllocationTracker::frames();
+    return count;
+}
 
-            timer.finish("visualization");
+extern "C" void setAllocationBudget(const char* stage, double allocationsPerFrame) {
+    AllocationTracker::setBudget(stage, allocationsPerFrame);
+}
+
+// Returns the number of stages over budget since the last start, logging each of them.
+extern "C" int checkAllocationBudget(double defaultBudget) {
+    return AllocationTracker::checkBudget(defaultBudget);
+}
+
+// Recognizes the image warmupFrames times, then counts the allocations of the next frames
+// against the budgets. Returns 0 when every stage is within budget, 1 when one is over and
+// -1 on error or when the library is built without allocation tracking.
+extern "C" int verifyAllocations(void* engineHandle, unsigned char* sourceImageData, int rows, int cols,
+                                 int warmupFrames, int frames, double defaultBudget) {
+    if (!AllocationTracker::available()) {
+        slog::err << "Allocation tracking is not built in, enable ENABLE_ALLOCATION_TRACKING" << slog::endl;
+        return -1;
+    }
+    try {
+        FaceRecognitionEngine &engine = engineHandle ? *static_cast<FaceRecognitionEngine*>(engineHandle)
+                                                     : defaultEngine();
+        cv::Mat image(rows, cols, CV_8UC3, sourceImageData);
+        cv::Mat detectedFacesImage(rows, cols, CV_8UC3);
+        cv::Mat recognizedFacesImage(rows, cols, CV_8UC3);
+        RecognitionResult recognition;
+
+        for (int i = 0; i < warmupFrames; ++i) {
+            engine.recognize(image, detectedFacesImage, recognizedFacesImage, recognition);
+        }
+        AllocationTracker::start();
+        for (int i = 0; i < frames; ++i) {
+            engine.recognize(image, detectedFacesImage, recognizedFacesImage, recognition);
         }
+        AllocationTracker::stop();
+        return AllocationTracker::checkBudget(defaultBudget) > 0 ? 1 : 0;
+    }
+    catch (const std::exception& error) {
+        AllocationTracker::stop();
+        slog::err << error.what() << slog::endl;
+        return -1;
     }
 }
 
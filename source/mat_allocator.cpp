@@ -0,0 +1,69 @@
+#include <new>
+
+#include "mat_allocator.hpp"
+
+namespace {
+
+class HugePageMatAllocator : public cv::MatAllocator {
+public:
+    explicit HugePageMatAllocator(HugePages hugePages) : _hugePages(hugePages) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0, size_t *step,
+                           int /*flags*/, cv::UMatUsageFlags /*usageFlags*/) const override {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+        unsigned char *data = static_cast<unsigned char *>(data0);
+        if (!data) {
+            data = static_cast<unsigned char *>(allocateNodeMemory(total, ANY_NODE, _hugePages));
+            if (!data) {
+                throw std::bad_alloc();
+            }
+        }
+        cv::UMatData *u = new cv::UMatData(this);
+        u->data = u->origdata = data;
+        u->size = total;
+        if (data0) {
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *u, int /*accessFlags*/, cv::UMatUsageFlags /*usageFlags*/) const override {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData *u) const override {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            freeNodeMemory(u->origdata, u->size, _hugePages);
+            u->origdata = 0;
+        }
+        delete u;
+    }
+
+private:
+    HugePages _hugePages;
+};
+
+}  // namespace
+
+cv::MatAllocator *hugePageMatAllocator(HugePages hugePages) {
+    static HugePageMatAllocator transparent(HugePages::Transparent);
+    static HugePageMatAllocator explicitPages(HugePages::Explicit);
+    switch (hugePages) {
+    case HugePages::Transparent: return &transparent;
+    case HugePages::Explicit: return &explicitPages;
+    default: return nullptr;
+    }
+}
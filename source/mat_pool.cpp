@@ -0,0 +1,34 @@
+#include "mat_pool.hpp"
+
+MatPool::MatPool(size_t maxBuffers) : _maxBuffers(maxBuffers) {
+    _buffers.reserve(maxBuffers);
+}
+
+cv::Mat MatPool::acquire(int rows, int cols, int type) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    cv::Mat *reusable = nullptr;
+    for (auto &buffer : _buffers) {
+        // Only the pool references the buffer; the count is read atomically, since the
+        // last outside reference may be released on another thread
+        if (buffer.u && CV_XADD(&buffer.u->refcount, 0) == 1) {
+            if (buffer.rows == rows && buffer.cols == cols && buffer.type() == type) {
+                return buffer;
+            }
+            reusable = &buffer;
+        }
+    }
+    if (reusable) {
+        reusable->create(rows, cols, type);
+        return *reusable;
+    }
+    if (_buffers.size() < _maxBuffers) {
+        _buffers.push_back(cv::Mat(rows, cols, type));
+        return _buffers.back();
+    }
+    return cv::Mat(rows, cols, type);
+}
+
+size_t MatPool::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _buffers.size();
+}
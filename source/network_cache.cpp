@@ -0,0 +1,185 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <samples/common.hpp>
+#include <samples/slog.hpp>
+
+#include "network_cache.hpp"
+
+using namespace InferenceEngine;
+
+namespace {
+
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+const uint64_t HASH_PRIME = 1099511628211ULL;
+
+// Version of what the library does to a network between reading and compiling it (input
+// and output precisions, batch, reshapes). Bump it when that changes, so that the
+// networks cached by older builds are compiled again.
+const uint32_t CACHE_FORMAT_VERSION = 1;
+
+// FNV-1a over 8 byte words, so that hashing the weights of a network runs at memory
+// speed; a cache key, not a checksum against tampering
+uint64_t hashBytes(const void *data, size_t size, uint64_t hash) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * HASH_PRIME;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    }
+    return (hash ^ size) * HASH_PRIME;
+}
+
+uint64_t hashString(const std::string &text, uint64_t hash) {
+    return hashBytes(text.data(), text.size(), hash);
+}
+
+uint64_t hashConfig(const std::map<std::string, std::string> &config, uint64_t hash) {
+    for (auto &&entry : config) {
+        hash = hashString(entry.second, hashString(entry.first, hash));
+    }
+    return hash;
+}
+
+uint64_t hashFile(const std::string &path, uint64_t hash) {
+    std::shared_ptr<const MappedFile> file = MappedFile::map(path);
+    return hashBytes(file->data(), file->size(), hash);
+}
+
+// Identity of the file at path: its resolved path, device, inode, size and modification
+// time. A replaced or rewritten model changes it without its weights being read.
+uint64_t hashFileIdentity(const std::string &path, uint64_t hash) {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        throw std::logic_error("Cannot open " + path);
+    }
+    char resolved[PATH_MAX];
+    hash = hashString(realpath(path.c_str(), resolved) ? resolved : path, hash);
+    const uint64_t identity[] = {static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino),
+                                 static_cast<uint64_t>(status.st_size), static_cast<uint64_t>(status.st_mtim.tv_sec),
+                                 static_cast<uint64_t>(status.st_mtim.tv_nsec)};
+    return hashBytes(identity, sizeof(identity), hash);
+}
+
+std::string baseName(const std::string &path) {
+    const size_t separator = path.find_last_of('/');
+    return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+}  // namespace
+
+MappedFile::~MappedFile() {
+    if (_base) {
+        munmap(_base, _size);
+    }
+}
+
+std::shared_ptr<const MappedFile> MappedFile::map(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::logic_error("Cannot open " + path);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        throw std::logic_error("File " + path + " is empty");
+    }
+    // Private and writable: a plugin modifying the weights in place gets its own copy of
+    // the pages it writes, the file is left untouched
+    void *base = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw std::logic_error("Cannot map " + path);
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->_base = static_cast<uint8_t *>(base);
+    file->_size = status.st_size;
+    return file;
+}
+
+std::shared_ptr<const MappedFile> mapWeights(CNNNetReader &reader, const std::string &binFileName) {
+    std::shared_ptr<const MappedFile> weights = MappedFile::map(binFileName);
+    reader.SetWeights(make_shared_blob<uint8_t>(TensorDesc(Precision::U8, {weights->size()}, Layout::C),
+                                                const_cast<uint8_t *>(weights->data()), weights->size()));
+    return weights;
+}
+
+uint64_t modelHash(const std::string &modelPath) {
+    return hashFile(fileNameNoExt(modelPath) + ".bin", hashFile(modelPath, HASH_SEED));
+}
+
+NetworkCache::NetworkCache(const std::string &directory, InferencePlugin &plugin, const std::string &deviceName,
+                           const std::map<std::string, std::string> &pluginConfig)
+    : _directory(directory), _plugin(plugin) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::logic_error("Cannot create network cache directory " + directory);
+    }
+    uint64_t hash = hashConfig(pluginConfig, hashString(deviceName, HASH_SEED));
+    const Version *version = plugin.GetVersion();
+    if (version) {
+        hash = hashBytes(&version->apiVersion, sizeof(version->apiVersion), hash);
+        hash = hashString(version->buildNumber ? version->buildNumber : "", hash);
+        hash = hashString(version->description ? version->description : "", hash);
+    }
+    _pluginHash = hash;
+}
+
+std::string NetworkCache::path(const std::string &modelPath, int batch,
+                               const std::map<std::string, std::string> &config) const {
+    uint64_t hash = hashBytes(&CACHE_FORMAT_VERSION, sizeof(CACHE_FORMAT_VERSION), _pluginHash);
+    hash = hashFileIdentity(fileNameNoExt(modelPath) + ".bin", hashFileIdentity(modelPath, hash));
+    hash = hashConfig(config, hashBytes(&batch, sizeof(batch), hash));
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+    return _directory + "/" + fileNameNoExt(baseName(modelPath)) + "-" + key + ".blob";
+}
+
+bool NetworkCache::import(const std::string &path, const std::map<std::string, std::string> &config,
+                          ExecutableNetwork &network) const {
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+    try {
+        network = _plugin.ImportNetwork(path, config);
+    }
+    catch (const std::exception &error) {
+        slog::warn << "Cannot import " << path << ", compiling the network: " << error.what() << slog::endl;
+        return false;
+    }
+    slog::info << "Imported compiled network " << path << slog::endl;
+    return true;
+}
+
+void NetworkCache::store(ExecutableNetwork &network, const std::string &path) const {
+    // Processes starting together export the same network, each to its own file first
+    const std::string exported = path + "." + std::to_string(getpid());
+    try {
+        network.Export(exported);
+    }
+    catch (const std::exception &error) {
+        slog::warn << "Cannot export the compiled network to " << path << ": " << error.what() << slog::endl;
+        std::remove(exported.c_str());
+        return;
+    }
+    if (std::rename(exported.c_str(), path.c_str()) != 0) {
+        slog::warn << "Cannot store the compiled network to " << path << slog::endl;
+        std::remove(exported.c_str());
+        return;
+    }
+    slog::info << "Exported compiled network " << path << slog::endl;
+}
@@ -0,0 +1,112 @@
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <samples/slog.hpp>
+
+#include "affinity.hpp"
+#include "node_memory.hpp"
+
+namespace {
+
+size_t mappedSize(size_t size, HugePages hugePages) {
+    if (hugePages == HugePages::None) return size;
+    return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+void *mapAnonymous(size_t size, HugePages hugePages) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    if (hugePages == HugePages::Explicit) {
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) return memory;
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true)) {
+            slog::warn << "No explicit huge pages available (see vm.nr_hugepages), using transparent ones" << slog::endl;
+        }
+    }
+#endif
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+    if (hugePages != HugePages::None) {
+        madvise(memory, size, MADV_HUGEPAGE);
+    }
+#endif
+    return memory;
+}
+
+// Node of every core, read once from sysfs
+const std::vector<int> &coreNodes() {
+    static const std::vector<int> nodes = [] {
+        std::vector<int> cores = availableCores();
+        std::vector<int> table(cores.empty() ? 1 : cores.back() + 1, 0);
+        for (int core : cores) {
+            table[core] = coreNode(core);
+        }
+        return table;
+    }();
+    return nodes;
+}
+
+}  // namespace
+
+int nodeCount() {
+    const std::vector<int> &nodes = coreNodes();
+    return *std::max_element(nodes.begin(), nodes.end()) + 1;
+}
+
+int currentNode() {
+#ifdef __linux__
+    const int core = sched_getcpu();
+    const std::vector<int> &nodes = coreNodes();
+    if (core >= 0 && core < static_cast<int>(nodes.size())) {
+        return nodes[core];
+    }
+#endif
+    return 0;
+}
+
+void *allocateNodeMemory(size_t size, int node, HugePages hugePages) {
+    size = mappedSize(size, hugePages);
+    void *memory = mapAnonymous(size, hugePages);
+    if (!memory) {
+        return nullptr;
+    }
+#ifdef __linux__
+    const int nodes = nodeCount();
+    if (nodes > 1 && (node == INTERLEAVED_NODES || (node >= 0 && node < nodes))) {
+        std::vector<unsigned long> mask(nodes / (8 * sizeof(unsigned long)) + 1, 0);
+        for (int n = 0; n < nodes; ++n) {
+            if (node == INTERLEAVED_NODES || n == node) {
+                mask[n / (8 * sizeof(unsigned long))] |= 1UL << (n % (8 * sizeof(unsigned long)));
+            }
+        }
+        // Pages are not touched yet, so the policy applies when they are first written
+        if (syscall(SYS_mbind, memory, size, node == INTERLEAVED_NODES ? MPOL_INTERLEAVE : MPOL_BIND,
+                    mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, 0) != 0) {
+            slog::warn << "Cannot place " << size << " bytes on NUMA node " << node << ", using the default policy: "
+                       << std::strerror(errno) << slog::endl;
+        }
+    }
+#else
+    (void)node;
+#endif
+    return memory;
+}
+
+void freeNodeMemory(void *memory, size_t size, HugePages hugePages) {
+    if (memory) {
+        munmap(memory, mappedSize(size, hugePages));
+    }
+}
@@ -0,0 +1,42 @@
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include <cstring>
+
+#include "perf_counters.hpp"
+
+TlbMissCounter::TlbMissCounter() : _fd(-1) {
+#ifdef __linux__
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HW_CACHE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_CACHE_DTLB |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    _fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+}
+
+TlbMissCounter::~TlbMissCounter() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool TlbMissCounter::available() const {
+    return _fd >= 0;
+}
+
+uint64_t TlbMissCounter::read() const {
+    uint64_t count = 0;
+    if (_fd < 0 || ::read(_fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return count;
+}
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include <samples/slog.hpp>
+
+#include "affinity.hpp"
+#include "gallery.hpp"
+#include "sharded_engine.hpp"
+
+struct ShardedEngine::Shard {
+    int node = 0;
+    std::vector<int> cores;
+    EngineConfig config;
+    std::unique_ptr<FaceRecognitionEngine> engine;
+    std::promise<void> created;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    struct Job {
+        FrameOptions options;
+        std::packaged_task<void()> run;
+        RecognitionResult *recognition;     // marked dropped before a shed job is run
+    };
+    std::deque<Job> jobs;               // in serving order
+    SchedulingStats stats = {0, 0, 0, 0};   // frames shed from the job queue
+    int runningShared = 0;              // jobs of the non interactive classes being served
+    bool stopping = false;
+};
+
+ShardedEngine::ShardedEngine(const ShardedEngineConfig &config) {
+    std::vector<int> cores = availableCores();
+    std::stable_sort(cores.begin(), cores.end(), [](int left, int right) { return coreNode(left) < coreNode(right); });
+
+    std::set<int> nodes;
+    for (int core : cores) {
+        nodes.insert(coreNode(core));
+    }
+    int shards = config.shards > 0 ? config.shards : static_cast<int>(nodes.size());
+    shards = std::max(1, std::min<int>(shards, cores.size()));
+
+    EngineConfig engineConfig = config.engine;
+    if (!config.galleryPath.empty()) {
+        engineConfig.gallery = Gallery::map(config.galleryPath);
+    } else if (!engineConfig.gallery) {
+        engineConfig.gallery = Gallery::builtin();
+    }
+    if (!engineConfig.galleryReplicas) {
+        engineConfig.galleryReplicas = std::make_shared<GalleryReplicas>(engineConfig.gallery, config.galleryPlacement,
+                                                                         engineConfig.hugePages);
+    }
+    _galleryReplicas = engineConfig.galleryReplicas;
+
+    for (int s = 0; s < shards; ++s) {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->cores.assign(cores.begin() + s * cores.size() / shards, cores.begin() + (s + 1) * cores.size() / shards);
+        shard->node = coreNode(shard->cores.front());
+        shard->config = engineConfig;
+        shard->config.cpuCores = shard->cores;
+        // The plugin binds threads to the first cores of the process, so shard inference
+        // threads stay unbound and inherit the affinity of the pinned serving thread.
+        shard->config.inferenceThreads = static_cast<int>(shard->cores.size());
+        shard->config.bindInferenceThreads = false;
+        _shards.push_back(std::move(shard));
+    }
+
+    try {
+        for (auto &shard : _shards) {
+            for (int thread = 0; thread < std::max(1, shard->config.inferRequests); ++thread) {
+                shard->threads.emplace_back(&ShardedEngine::serve, this, std::ref(*shard), thread);
+            }
+        }
+        // Shard engines are created concurrently
+        for (auto &shard : _shards) {
+            shard->created.get_future().get();
+        }
+    }
+    catch (...) {
+        stop();
+        throw;
+    }
+
+    for (int s = 0; s < size(); ++s) {
+        slog::info << "Shard " << s << ": node " << node(s) << ", cores " << _shards[s]->cores.front()
+                   << "-" << _shards[s]->cores.back() << slog::endl;
+    }
+}
+
+ShardedEngine::~ShardedEngine() {
+    stop();
+}
+
+void ShardedEngine::stop() {
+    for (auto &shard : _shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->stopping = true;
+        }
+        shard->wakeUp.notify_all();
+    }
+    for (auto &shard : _shards) {
+        for (auto &thread : shard->threads) {
+            if (thread.joinable()) thread.join();
+        }
+    }
+}
+
+void ShardedEngine::serve(Shard &shard, int thread) {
+    if (!pinCurrentThread(shard.cores)) {
+        slog::warn << "Cannot pin serving thread to cores " << shard.cores.front() << "-" << shard.cores.back() << slog::endl;
+    }
+    if (thread == 0) {
+        try {
+            shard.engine.reset(new FaceRecognitionEngine(shard.config));
+            shard.created.set_value();
+        }
+        catch (...) {
+            shard.created.set_exception(std::current_exception());
+            return;
+        }
+    }
+
+    // Like the engine's infer requests, the serving threads reserved for interactive
+    // frames do not serve the other classes, so that an interactive frame always finds one.
+    const int sharedThreads = std::max(1, shard.config.inferRequests) - shard.config.reservedInteractiveRequests;
+    auto runnable = [&shard, sharedThreads] {
+        return !shard.jobs.empty() && (shard.jobs.front().options.priority == FramePriority::Interactive ||
+                                       shard.runningShared < sharedThreads);
+    };
+    for (;;) {
+        std::packaged_task<void()> job;
+        bool shared;
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.wakeUp.wait(lock, [&shard, &runnable] { return shard.stopping || runnable(); });
+            if (!runnable()) return;
+            shared = shard.jobs.front().options.priority != FramePriority::Interactive;
+            shard.runningShared += shared;
+            job = std::move(shard.jobs.front().run);
+            shard.jobs.pop_front();
+        }
+        job();
+        if (shared) {
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                --shard.runningShared;
+            }
+            shard.wakeUp.notify_all();
+        }
+    }
+}
+
+int ShardedEngine::shardOf(const std::string &stream) const {
+    return static_cast<int>(std::hash<std::string>()(stream) % _shards.size());
+}
+
+void ShardedEngine::recognize(const std::string &stream, const cv::Mat &image, cv::Mat &detectedFacesImage,
+                              cv::Mat &recognizedFacesImage, RecognitionResult &recognition,
+                              const FrameOptions &options) {
+    Shard &shard = *_shards[shardOf(stream)];
+    recognition.dropped = false;
+    std::packaged_task<void()> job([&] {
+        if (recognition.dropped) return;
+        shard.engine->recognize(image, detectedFacesImage, recognizedFacesImage, recognition, options);
+    });
+    std::future<void> done = job.get_future();
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const int maxQueuedFrames = shard.config.maxQueuedFrames;
+        if (maxQueuedFrames > 0 && static_cast<int>(shard.jobs.size()) >= maxQueuedFrames) {
+            // The queue stays bounded: the least urgent of the queued frames and this one is shed
+            Shard::Job &last = shard.jobs.back();
+            const bool shedSelf = !servedBefore(options, last.options);
+            const FrameOptions &shedOptions = shedSelf ? options : last.options;
+            ++shard.stats.shed;
+            shard.stats.reverificationsDropped += shedOptions.reverification;
+            if (shedSelf) {
+                recognition.clear();
+                recognition.dropped = true;
+                return;
+            }
+            last.recognition->clear();
+            last.recognition->dropped = true;
+            last.run();
+            shard.jobs.pop_back();
+        }
+        auto position = std::find_if(shard.jobs.begin(), shard.jobs.end(), [&options](const Shard::Job &queued) {
+            return servedBefore(options, queued.options);
+        });
+        shard.jobs.insert(position, Shard::Job {options, std::move(job), &recognition});
+    }
+    shard.wakeUp.notify_one();
+    done.get();
+}
+
+int ShardedEngine::size() const {
+    return static_cast<int>(_shards.size());
+}
+
+const std::vector<int> &ShardedEngine::cores(int shard) const {
+    return _shards.at(shard)->cores;
+}
+
+int ShardedEngine::node(int shard) const {
+    return _shards.at(shard)->node;
+}
+
+std::shared_ptr<GalleryReplicas> ShardedEngine::galleryReplicas() const {
+    return _galleryReplicas;
+}
+
+SchedulingStats ShardedEngine::schedulingStats() const {
+    SchedulingStats total = {0, 0, 0, 0};
+    for (auto &shard : _shards) {
+        SchedulingStats stats = shard->engine->schedulingStats();
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            stats.shed += shard->stats.shed;
+            stats.reverificationsDropped += shard->stats.reverificationsDropped;
+        }
+        total.recognized += stats.recognized;
+        total.expired += stats.expired;
+        total.shed += stats.shed;
+        total.reverificationsDropped += stats.reverificationsDropped;
+    }
+    return total;
+}
@@ -0,0 +1,188 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <samples/slog.hpp>
+
+#include "shared_ring.hpp"
+
+// The Python client reads these structs through numpy dtypes of fixed size.
+static_assert(sizeof(SharedRingHeader) == 64, "SharedRingHeader layout changed");
+static_assert(sizeof(SharedResultHeader) == 64, "SharedResultHeader layout changed");
+static_assert(sizeof(SharedFaceRecord) == 64, "SharedFaceRecord layout changed");
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment = 64) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+SharedRing::SharedRing() : _base(nullptr), _size(0), _layout(), _resultLayout() {
+}
+
+SharedRing::~SharedRing() {
+    destroy();
+}
+
+void SharedRing::create(const std::string &name, int slotCount, int maxRows, int maxCols, int maxFaces) {
+    if (slotCount <= 0 || maxRows <= 0 || maxCols <= 0 || maxFaces < 0) {
+        throw std::logic_error("Shared ring dimensions shall be positive");
+    }
+    destroy();
+
+    const size_t imageSize = alignUp(size_t(maxRows) * maxCols * 3);
+    const size_t frameSlotSize = imageSize;
+    const size_t detectionOffset = alignUp(sizeof(SharedResultHeader) + maxFaces * sizeof(SharedFaceRecord));
+    const size_t recognitionOffset = detectionOffset + imageSize;
+    const size_t alignedOffset = recognitionOffset + imageSize;
+    // Aligned faces are crops of the frame, so one frame worth of pixels holds them
+    // unless the detections overlap heavily.
+    const size_t alignedCapacity = imageSize;
+    const size_t resultSlotSize = alignedOffset + alignedCapacity;
+
+    const size_t framesOffset = alignUp(sizeof(SharedRingHeader));
+    const size_t resultsOffset = framesOffset + slotCount * frameSlotSize;
+    const size_t size = resultsOffset + slotCount * resultSlotSize;
+
+    // A segment left by a crashed engine or owned by another process is not reused
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        throw std::logic_error("Shared memory segment " + name + " already exists, unlink it if it is stale");
+    }
+    if (fd < 0) {
+        throw std::logic_error("Cannot open shared memory segment " + name);
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::logic_error("Cannot resize shared memory segment " + name);
+    }
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::logic_error("Cannot map shared memory segment " + name);
+    }
+
+    _name = name;
+    _base = static_cast<unsigned char *>(base);
+    _size = size;
+    _busy.assign(slotCount, false);
+
+    std::memset(&_layout, 0, sizeof(_layout));
+    _layout.magic = SHARED_RING_MAGIC;
+    _layout.version = SHARED_RING_VERSION;
+    _layout.slotCount = slotCount;
+    _layout.maxRows = maxRows;
+    _layout.maxCols = maxCols;
+    _layout.maxFaces = maxFaces;
+    _layout.frameSlotSize = frameSlotSize;
+    _layout.resultSlotSize = resultSlotSize;
+    _layout.framesOffset = framesOffset;
+    _layout.resultsOffset = resultsOffset;
+    std::memcpy(_base, &_layout, sizeof(_layout));
+
+    std::memset(&_resultLayout, 0, sizeof(_resultLayout));
+    _resultLayout.detectionOffset = detectionOffset;
+    _resultLayout.recognitionOffset = recognitionOffset;
+    _resultLayout.alignedOffset = alignedOffset;
+    _resultLayout.alignedCapacity = alignedCapacity;
+    for (int slot = 0; slot < slotCount; ++slot) {
+        std::memcpy(&result(slot), &_resultLayout, sizeof(_resultLayout));
+    }
+
+    slog::info << "Shared ring " << name << " created: " << slotCount << " slots, "
+               << size / (1024 * 1024) << " MB" << slog::endl;
+}
+
+void SharedRing::destroy() {
+    if (!_base) return;
+    munmap(_base, _size);
+    shm_unlink(_name.c_str());
+    _base = nullptr;
+    _size = 0;
+    _busy.clear();
+}
+
+bool SharedRing::isOpen() const {
+    return _base != nullptr;
+}
+
+int SharedRing::acquire() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t slot = 0; slot < _busy.size(); ++slot) {
+        if (!_busy[slot]) {
+            _busy[slot] = true;
+            return static_cast<int>(slot);
+        }
+    }
+    return -1;
+}
+
+void SharedRing::release(int slot) {
+    checkSlot(slot, 0, 0);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _busy[slot] = false;
+}
+
+cv::Mat SharedRing::frame(int slot, int rows, int cols) {
+    checkSlot(slot, rows, cols);
+    const SharedRingHeader &ringHeader = header();
+    return cv::Mat(rows, cols, CV_8UC3, _base + ringHeader.framesOffset + slot * ringHeader.frameSlotSize);
+}
+
+cv::Mat SharedRing::detectionImage(int slot, int rows, int cols) {
+    checkSlot(slot, rows, cols);
+    return cv::Mat(rows, cols, CV_8UC3, resultSlot(slot) + _resultLayout.detectionOffset);
+}
+
+cv::Mat SharedRing::recognitionImage(int slot, int rows, int cols) {
+    checkSlot(slot, rows, cols);
+    return cv::Mat(rows, cols, CV_8UC3, resultSlot(slot) + _resultLayout.recognitionOffset);
+}
+
+SharedResultHeader &SharedRing::result(int slot) {
+    return *reinterpret_cast<SharedResultHeader *>(resultSlot(slot));
+}
+
+SharedFaceRecord *SharedRing::faces(int slot) {
+    return reinterpret_cast<SharedFaceRecord *>(resultSlot(slot) + sizeof(SharedResultHeader));
+}
+
+unsigned char *SharedRing::alignedFaces(int slot) {
+    return resultSlot(slot) + _resultLayout.alignedOffset;
+}
+
+size_t SharedRing::alignedCapacity() const {
+    return _resultLayout.alignedCapacity;
+}
+
+const SharedRingHeader &SharedRing::header() const {
+    if (!_base) {
+        throw std::logic_error("Shared ring is not created");
+    }
+    return _layout;
+}
+
+unsigned char *SharedRing::resultSlot(int slot) {
+    const SharedRingHeader &ringHeader = header();
+    return _base + ringHeader.resultsOffset + slot * ringHeader.resultSlotSize;
+}
+
+void SharedRing::checkSlot(int slot, int rows, int cols) const {
+    const SharedRingHeader &ringHeader = header();
+    if (slot < 0 || slot >= static_cast<int>(ringHeader.slotCount)) {
+        throw std::logic_error("Shared ring slot " + std::to_string(slot) + " is out of range");
+    }
+    if (rows < 0 || cols < 0 || rows > static_cast<int>(ringHeader.maxRows) || cols > static_cast<int>(ringHeader.maxCols)) {
+        throw std::logic_error("Frame " + std::to_string(cols) + "x" + std::to_string(rows) +
+                               " does not fit into the shared ring slot");
+    }
+}
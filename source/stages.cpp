@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <string>
+
+#include <samples/ocv_common.hpp>
+
+#include "alignment.hpp"
+#include "stages.hpp"
+
+using namespace InferenceEngine;
+
+namespace {
+
+// Stage timer names, constructed once so that timing a stage does not allocate
+const std::string DETECTION_TIMER = "detection";
+const std::string POSTPROCESSING_TIMER = "data postprocessing";
+const std::string LANDMARKS_TIMER = "facial landmarks detector";
+const std::string PREPROCESSING_TIMER = "face preprocessing";
+const std::string FEATURE_EXTRACTOR_TIMER = "feature extractor";
+const std::string CLASSIFIER_TIMER = "classifier";
+const std::string VISUALIZATION_TIMER = "visualization";
+
+}  // namespace
+
+bool DetectFaces::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    context.timer.startSpan(DETECTION_TIMER);
+    if (_resources.detectionBatcher) {
+        // The batch completes through the completion of the context's detector
+        _resources.detectionBatcher->detect(*frame.image, frame.recognition->detections,
+                                            context.faceDetector.completion);
+        return true;
+    }
+    context.faceDetector.enqueue(*frame.image);
+    context.faceDetector.submitRequest();
+    return true;
+}
+
+bool DetectFaces::resume(InferContext &context) {
+    // A detection batch already wrote the detections of the frame
+    if (!_resources.detectionBatcher) {
+        context.faceDetector.fetchResults();
+        context.frame.recognition->detections = context.faceDetector.results;
+    }
+    context.timer.finishSpan(DETECTION_TIMER);
+    return false;
+}
+
+bool EstimateLandmarks::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    FacialLandmarksDetection &facialLandmarksDetector = context.facialLandmarksDetector;
+    RecognitionResult &recognition = *frame.recognition;
+    auto &detectedFaces = recognition.detectedFaces;
+
+    {
+        Timer::Scope timed(context.timer, POSTPROCESSING_TIMER);
+        // Filling inputs of face analytics networks, one batch slot per face
+        const cv::Mat &image = *frame.image;
+        const cv::Rect frameRect(0, 0, image.cols, image.rows);
+        for (auto &&face : recognition.detections) {
+            detectedFaces.push_back(image(face.location & frameRect));
+        }
+        Blob::Ptr landmarksInput = facialLandmarksDetector.enqueueBatch(detectedFaces.size());
+        _resources.scheduler.parallelFor(facialLandmarksDetector.enquedFaces, [&](int i) {
+            matU8ToBlob(detectedFaces[i], landmarksInput, i, context.faceBuffers[i]);
+        });
+    }
+
+    // Running Facial Landmarks Estimation network
+    if (facialLandmarksDetector.enquedFaces == 0) return false;
+    context.timer.startSpan(LANDMARKS_TIMER);
+    facialLandmarksDetector.submitRequest();
+    return true;
+}
+
+bool EstimateLandmarks::resume(InferContext &context) {
+    context.timer.finishSpan(LANDMARKS_TIMER);
+    return false;
+}
+
+bool AlignFaces::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    FacialLandmarksDetection &facialLandmarksDetector = context.facialLandmarksDetector;
+    RecognitionResult &recognition = *frame.recognition;
+    auto &detectedFaces = recognition.detectedFaces;
+    auto &alignedFaces = recognition.alignedFaces;
+    if (detectedFaces.empty()) return false;
+
+    Timer::Scope timed(context.timer, PREPROCESSING_TIMER);
+    // Faces above the landmarks batch were not estimated
+    const int alignedCount = std::min<int>(std::min<int>(detectedFaces.size(), facialLandmarksDetector.maxBatch),
+                                           recognition.alignedArena.capacity());
+    const LandmarksBatch landmarks = facialLandmarksDetector.landmarks(alignedCount);
+    for (int i = 0; i < alignedCount; ++i) {
+        alignedFaces.push_back(recognition.alignedArena.allocate());
+    }
+
+    _resources.scheduler.parallelFor(alignedCount, [&](int i) {
+        const LandmarksView face = landmarks[i];
+        if (!alignFace(detectedFaces[i], face.leftEye(), face.rightEye(), alignedFaces[i])) {
+            recognition.alignedArena.reject(i);
+            alignedFaces[i] = cv::Mat();
+        }
+    });
+
+    for (size_t i = 0; i < alignedFaces.size(); ++i) {
+        if (!alignedFaces[i].empty()) {
+            frame.embeddedFaces.push_back(&alignedFaces[i]);
+            frame.embeddedSlots.push_back(i);
+        }
+    }
+    return false;
+}
+
+bool CropFaces::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    RecognitionResult &recognition = *frame.recognition;
+    auto &detectedFaces = recognition.detectedFaces;
+    auto &alignedFaces = recognition.alignedFaces;
+
+    Timer::Scope timed(context.timer, PREPROCESSING_TIMER);
+    const cv::Mat &image = *frame.image;
+    const cv::Rect frameRect(0, 0, image.cols, image.rows);
+    for (auto &&face : recognition.detections) {
+        detectedFaces.push_back(image(face.location & frameRect));
+    }
+    const int count = std::min<int>(detectedFaces.size(), recognition.alignedArena.capacity());
+    for (int i = 0; i < count; ++i) {
+        alignedFaces.push_back(recognition.alignedArena.allocate());
+    }
+    // The arena slots have the embedding input size, resize() writes into them in place
+    _resources.scheduler.parallelFor(count, [&](int i) {
+        if (detectedFaces[i].empty()) {
+            recognition.alignedArena.reject(i);
+            alignedFaces[i] = cv::Mat();
+        } else {
+            cv::resize(detectedFaces[i], alignedFaces[i], alignedFaces[i].size());
+        }
+    });
+    for (size_t i = 0; i < alignedFaces.size(); ++i) {
+        if (!alignedFaces[i].empty()) {
+            frame.embeddedFaces.push_back(&alignedFaces[i]);
+            frame.embeddedSlots.push_back(i);
+        }
+    }
+    return false;
+}
+
+bool ExtractFeatures::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    context.timer.startSpan(FEATURE_EXTRACTOR_TIMER);
+    frame.featureVectors.assign(frame.embeddedFaces.size() * context.featureExtractor.featureVectorSize, 0.f);
+    frame.submittedFaces = 0;
+    if (_resources.embeddingBatcher && !frame.embeddedFaces.empty()) {
+        // The batches complete through the completion of the context's extractor
+        _resources.embeddingBatcher->embed(frame.embeddedFaces.data(), frame.embeddedFaces.size(),
+                                           frame.featureVectors.data(), context.featureExtractor.completion);
+        return true;
+    }
+    return submitChunk(context);
+}
+
+bool ExtractFeatures::resume(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    // Embedding batches already wrote the feature vectors of the frame
+    if (_resources.embeddingBatcher) {
+        context.timer.finishSpan(FEATURE_EXTRACTOR_TIMER);
+        return false;
+    }
+    FeatureExtraction &featureExtractor = context.featureExtractor;
+    const size_t featureVectorSize = featureExtractor.featureVectorSize;
+    featureExtractor.fetchResults();
+    std::copy(featureExtractor.results.begin(), featureExtractor.results.end(),
+              frame.featureVectors.begin() + (frame.submittedFaces - featureExtractor.submittedFrames) * featureVectorSize);
+    return submitChunk(context);
+}
+
+bool ExtractFeatures::submitChunk(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    FeatureExtraction &featureExtractor = context.featureExtractor;
+    // Embedded faces go through the extractor in chunks of its batch, one inference at a time
+    const size_t first = frame.submittedFaces;
+    if (first == frame.embeddedFaces.size()) {
+        context.timer.finishSpan(FEATURE_EXTRACTOR_TIMER);
+        return false;
+    }
+    const size_t count = std::min<size_t>(featureExtractor.maxBatch, frame.embeddedFaces.size() - first);
+    for (size_t i = 0; i < count; ++i) {
+        featureExtractor.enqueue(*frame.embeddedFaces[first + i]);
+    }
+    frame.submittedFaces += count;
+    featureExtractor.submitRequest();
+    return true;
+}
+
+bool ClassifyFaces::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    RecognitionResult &recognition = *frame.recognition;
+    auto &persons = recognition.persons;
+    const size_t featureVectorSize = context.featureExtractor.featureVectorSize;
+
+    Timer::Scope timed(context.timer, CLASSIFIER_TIMER);
+    // Labels up to the small string size are assigned without allocating,
+    // faces which were not aligned keep an empty label
+    persons.resize(recognition.alignedFaces.size());
+    _resources.scheduler.parallelFor(frame.embeddedFaces.size(), [&](int row) {
+        _resources.classifier.classify(frame.featureVectors.data() + row * featureVectorSize, featureVectorSize,
+                                       persons[frame.embeddedSlots[row]]);
+    });
+    return false;
+}
+
+bool DrawResults::run(InferContext &context) {
+    InferContext::Frame &frame = context.frame;
+    const RecognitionResult &recognition = *frame.recognition;
+    const cv::Mat &image = *frame.image;
+    const auto &detectionResults = recognition.detections;
+    const auto &persons = recognition.persons;
+
+    Timer::Scope timed(context.timer, VISUALIZATION_TIMER);
+    // For every detected face, the two output images are drawn concurrently
+    _resources.scheduler.parallelFor(2, [&](int target) {
+        cv::Mat &faces = target == 0 ? *frame.detectedFacesImage : *frame.recognizedFacesImage;
+        image.copyTo(faces);
+
+        int i = 0;
+        for (auto &result : detectionResults) {
+            cv::rectangle(faces, result.location, cv::Scalar(100, 100, 100), 5);
+
+            if (target == 1 && i < static_cast<int>(persons.size())) {
+                //Here is detection confidence, but recognition confidence shall be calculated.
+                //<< ": " << std::fixed << std::setprecision(3) << result.confidence;
+                cv::putText(faces,
+                            persons[i],
+                            cv::Point2f(result.location.x, result.location.y - 15),
+                            cv::FONT_HERSHEY_COMPLEX,
+                            2,
+                            cv::Scalar(0, 0, 255));
+            }
+            i++;
+        }
+    });
+    return false;
+}
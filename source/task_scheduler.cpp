@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+#include <samples/slog.hpp>
+
+#include "affinity.hpp"
+#include "allocation_tracker.hpp"
+#include "task_scheduler.hpp"
+
+namespace {
+
+thread_local const TaskScheduler *workerScheduler = nullptr;
+thread_local int workerIndex = -1;
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(int workers, const std::vector<int> &cores)
+    : _pending(0), _nextQueue(0), _stopping(false) {
+    for (int i = 0; i < workers; ++i) {
+        _queues.emplace_back(new Queue());
+    }
+    for (int i = 0; i < workers; ++i) {
+        std::vector<int> workerCores;
+        if (!cores.empty()) {
+            workerCores.push_back(cores[i % cores.size()]);
+        }
+        _threads.emplace_back(&TaskScheduler::workerLoop, this, i, workerCores);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wakeUp.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+int TaskScheduler::size() const {
+    return static_cast<int>(_threads.size());
+}
+
+int TaskScheduler::currentWorker() const {
+    return workerScheduler == this ? workerIndex : -1;
+}
+
+void TaskScheduler::Queue::pushBack(Task &&task) {
+    if (count == tasks.size()) {
+        std::vector<Task> grown(tasks.size() * 2);
+        for (size_t i = 0; i < count; ++i) {
+            grown[i] = std::move(tasks[(head + i) % tasks.size()]);
+        }
+        tasks.swap(grown);
+        head = 0;
+    }
+    tasks[(head + count) % tasks.size()] = std::move(task);
+    ++count;
+}
+
+bool TaskScheduler::Queue::popBack(Task &task) {
+    if (!count) return false;
+    --count;
+    task = std::move(tasks[(head + count) % tasks.size()]);
+    return true;
+}
+
+bool TaskScheduler::Queue::popFront(Task &task) {
+    if (!count) return false;
+    task = std::move(tasks[head]);
+    head = (head + 1) % tasks.size();
+    --count;
+    return true;
+}
+
+void TaskScheduler::submit(Task task) {
+    if (_queues.empty()) {
+        task();
+        return;
+    }
+    int index = currentWorker();
+    if (index < 0) {
+        index = _nextQueue++ % _queues.size();
+    }
+    ++_pending;
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        _queues[index]->pushBack(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wakeUp.notify_one();
+}
+
+bool TaskScheduler::tryRun(int preferred) {
+    Task task;
+    bool found = false;
+    if (preferred >= 0) {
+        std::lock_guard<std::mutex> lock(_queues[preferred]->mutex);
+        found = _queues[preferred]->popBack(task);
+    }
+    const size_t count = _queues.size();
+    const size_t start = preferred >= 0 ? preferred : _nextQueue.load() % count;
+    for (size_t k = 1; !found && k <= count; ++k) {
+        Queue &victim = *_queues[(start + k) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        found = victim.popFront(task);
+    }
+    if (!found) return false;
+    --_pending;
+    task();
+    return true;
+}
+
+void TaskScheduler::workerLoop(int index, std::vector<int> cores) {
+    workerScheduler = this;
+    workerIndex = index;
+    if (!cores.empty() && !pinCurrentThread(cores)) {
+        slog::warn << "Cannot pin CPU stage worker " << index << " to core " << cores[0] << slog::endl;
+    }
+
+    for (;;) {
+        if (tryRun(index)) continue;
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [this] { return _stopping || _pending > 0; });
+        if (_stopping && _pending == 0) return;
+    }
+}
+
+void TaskScheduler::runUntil(const std::atomic<bool> &done) {
+    const int self = currentWorker();
+    while (!done) {
+        if (!_queues.empty() && tryRun(self)) continue;
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [this, &done] { return done || (_pending > 0 && !_queues.empty()); });
+    }
+}
+
+void TaskScheduler::complete(std::atomic<bool> &done) {
+    std::lock_guard<std::mutex> lock(_sleepMutex);
+    done = true;
+    _wakeUp.notify_all();
+}
+
+void TaskScheduler::parallelInvoke(int count, void (*invoke)(const void *, int), const void *body) {
+    if (count <= 0) return;
+    if (_queues.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            invoke(body, i);
+        }
+        return;
+    }
+
+    // Lives on the caller's stack: helpers claim indices until none is left and
+    // check out under the mutex, so none of them touches it after the wait below.
+    struct Group {
+        void (*invoke)(const void *, int);
+        const void *body;
+        int count;
+        std::atomic<int> next;
+        int helpers;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+        int stage;      // allocations of the helpers are charged to the caller's stage
+
+        void work() {
+            AllocationTracker::Stage charged(stage);
+            for (int i = next++; i < count; i = next++) {
+                try {
+                    invoke(body, i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        }
+    } group;
+    group.invoke = invoke;
+    group.body = body;
+    group.count = count;
+    group.next = 0;
+    group.stage = AllocationTracker::currentStage();
+    group.helpers = std::min<int>(count - 1, _queues.size());
+
+    const int helpers = group.helpers;
+    for (int h = 0; h < helpers; ++h) {
+        Group *shared = &group;
+        submit([shared] {
+            shared->work();
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (--shared->helpers == 0) shared->finished.notify_all();
+        });
+    }
+    group.work();
+
+    // Help with the queued work instead of parking the caller
+    const int self = currentWorker();
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(group.mutex);
+            if (group.helpers == 0) break;
+        }
+        if (tryRun(self)) continue;
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.finished.wait_for(lock, std::chrono::microseconds(200), [&group] { return group.helpers == 0; });
+    }
+
+    if (group.error) {
+        std::rethrow_exception(group.error);
+    }
+}
@@ -1,21 +1,74 @@
 #include "utility.hpp"
+#include "network_cache.hpp"
+
+void matU8ToBlob(const cv::Mat &image, const InferenceEngine::Blob::Ptr &blob, int batchIndex, cv::Mat &resized) {
+    const InferenceEngine::SizeVector &blobSize = blob->getTensorDesc().getDims();
+    const size_t width = blobSize[3];
+    const size_t height = blobSize[2];
+    const size_t channels = blobSize[1];
+    uint8_t *blobData = blob->buffer().as<uint8_t *>();
+
+    const cv::Mat *source = &image;
+    if (static_cast<size_t>(image.cols) != width || static_cast<size_t>(image.rows) != height) {
+        cv::resize(image, resized, cv::Size(width, height));
+        source = &resized;
+    }
+
+    const size_t batchOffset = batchIndex * width * height * channels;
+    for (size_t h = 0; h < height; h++) {
+        const uint8_t *row = source->ptr<uint8_t>(h);
+        for (size_t w = 0; w < width; w++) {
+            for (size_t c = 0; c < channels; c++) {
+                blobData[batchOffset + c * width * height + h * width + w] = row[w * channels + c];
+            }
+        }
+    }
+}
 
 template<typename Component>
 Load<Component>::Load(Component& component) : component(component) {
 }
 
 template <typename Component>
-void Load<Component>::into(InferenceEngine::InferencePlugin & plg, bool enable_dynamic_batch) const {
+void Load<Component>::into(InferenceEngine::InferencePlugin & plg, bool enable_dynamic_batch,
+                           const NetworkCache *cache) const {
     if (component.enabled()) {
         std::map<std::string, std::string> config;
         if (enable_dynamic_batch) {
             config[InferenceEngine::PluginConfigParams::KEY_DYN_BATCH_ENABLED] = InferenceEngine::PluginConfigParams::YES;
         }
-        component.net = plg.LoadNetwork(component.read(), config);
+        const std::string cached = cache ? cache->path(component.pathToModel, component.maxBatch, config) : std::string();
+        if (cache && cache->import(cached, config, component.net)) {
+            component.read(false);
+        } else {
+            component.net = plg.LoadNetwork(component.read(), config);
+            if (cache) cache->store(component.net, cached);
+        }
         component.plugin = &plg;
     }
 }
 
+template <typename Component>
+void warmUp(Component &component, int inferences) {
+    if (!component.enabled() || inferences <= 0) return;
+    // Mid-gray faces, the inference time does not depend on the pixels
+    const cv::Mat input(64, 64, CV_8UC3, cv::Scalar(128, 128, 128));
+    const int largestBatch = component.isBatchDynamic ? component.maxBatch : 1;
+    for (int batch = 1; batch <= largestBatch; ++batch) {
+        for (int i = 0; i < inferences; ++i) {
+            for (int slot = 0; slot < batch; ++slot) {
+                component.enqueue(input);
+            }
+            component.submitRequest();
+            component.wait();
+        }
+    }
+}
+
+template void warmUp(FaceDetection &component, int inferences);
+template void warmUp(FacialLandmarksDetection &component, int inferences);
+template void warmUp(FeatureExtraction &component, int inferences);
+
 template class Load<BaseDetection>;
 template class Load<FaceDetection>;
 template class Load<FacialLandmarksDetection>;
@@ -56,16 +109,23 @@ void CallStat::setStartTime() {
 }
 
 
-void Timer::start(const std::string& name) {
+Timer::Scope::Scope(Timer &timer, const std::string &name) : _timer(timer._timers[name]), _stage(name) {
+    _timer.setStartTime();
+}
+
+Timer::Scope::~Scope() {
+    _timer.calculateDuration();
+}
+
+void Timer::startSpan(const std::string& name) {
     if (_timers.find(name) == _timers.end()) {
         _timers[name] = CallStat();
     }
     _timers[name].setStartTime();
 }
 
-void Timer::finish(const std::string& name) {
-    auto& timer = (*this)[name];
-    timer.calculateDuration();
+void Timer::finishSpan(const std::string& name) {
+    (*this)[name].calculateDuration();
 }
 
 CallStat& Timer::operator[](const std::string& name) {
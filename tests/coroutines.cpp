@@ -0,0 +1,83 @@
+// Runs the coroutine interface without models: awaited tasks compose and report their
+// exceptions through spawn(), and awaiting a disabled model or an empty batch continues
+// inline instead of suspending for a completion which never comes. Requires
+// ENABLE_COROUTINES and a C++20 compiler.
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "coroutines.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+Task<int> answer() {
+    co_return 42;
+}
+
+Task<int> twice() {
+    const int first = co_await answer();
+    const int second = co_await answer();
+    co_return first + second;
+}
+
+Task<void> fail() {
+    co_await answer();
+    throw std::runtime_error("failed");
+}
+
+Task<void> flow(AsyncFaceDetector &detector, AsyncLandmarksEstimator &landmarks, AsyncFeatureExtractor &extractor,
+                const cv::Mat &frame, bool &finished) {
+    check(co_await twice() == 84, "awaited tasks return their value");
+    const auto &faces = co_await detector.detect(frame);
+    check(faces.empty(), "a disabled detector finds no faces");
+    const LandmarksBatch points = co_await landmarks.run(std::vector<cv::Mat>());
+    check(points.size() == 0, "no faces have no landmarks");
+    const std::vector<float> embeddings = co_await extractor.embed(std::vector<cv::Mat>(3, frame));
+    check(embeddings.size() == 3 * 4 && std::all_of(embeddings.begin(), embeddings.end(),
+                                                    [](float value) { return value == 0.f; }),
+          "a disabled extractor embeds zeros");
+    finished = true;
+}
+
+}  // namespace
+
+int main() {
+    InlineExecutor executor;
+    // Without a model path the components are disabled and never start a request
+    FaceDetection faceDetector("", "CPU", 1, false, true, 0.5, false);
+    FacialLandmarksDetection landmarksEstimator("", "CPU", 1, false, true);
+    FeatureExtraction featureExtractor("", "CPU", 1, false, true);
+    featureExtractor.featureVectorSize = 4;
+    AsyncFaceDetector detector(faceDetector, executor);
+    AsyncLandmarksEstimator landmarks(landmarksEstimator, executor);
+    AsyncFeatureExtractor extractor(featureExtractor, executor);
+    const cv::Mat frame(64, 64, CV_8UC3);
+
+    bool finished = false;
+    bool done = false;
+    spawn(flow(detector, landmarks, extractor, frame, finished), [&done](std::exception_ptr error) {
+        check(!error, "the flow does not fail");
+        done = true;
+    });
+    check(finished && done, "the flow completes without a request started");
+
+    bool failed = false;
+    spawn(fail(), [&failed](std::exception_ptr error) { failed = error != nullptr; });
+    check(failed, "spawn() reports the exception of a task");
+
+    if (failures == 0) {
+        std::cout << "Coroutine interface OK" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
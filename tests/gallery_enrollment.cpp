@@ -0,0 +1,71 @@
+// Runs the gallery check of a feature extraction swap without models or devices: a gallery
+// stamped as FaceRecognitionEngine::enroll() does is accepted with the network it was
+// enrolled with, also once saved and mapped again, and refused with another network, another
+// version of the same network or when it is not stamped.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gallery.hpp"
+#include "network_cache.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// Writes the .xml and .bin files of a fake network, returns the model path
+std::string writeModel(const std::string &directory, const std::string &name, const std::string &weights) {
+    const std::string path = directory + "/" + name + ".xml";
+    std::ofstream(path) << "<net name=\"" << name << "\"/>";
+    std::ofstream(directory + "/" + name + ".bin", std::ios::binary) << weights;
+    return path;
+}
+
+}  // namespace
+
+int main() {
+    char directory[] = "/tmp/gallery_enrollment_XXXXXX";
+    if (!mkdtemp(directory)) {
+        std::cerr << "Cannot create a temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string enrolled = writeModel(directory, "enrolled", "weights of the enrolled network");
+    const std::string other = writeModel(directory, "other", "weights of another network");
+
+    const std::vector<std::string> labels = {"alice", "bob"};
+    const std::vector<int> rowLabels = {0, 1, 1};
+    const std::vector<std::vector<float>> embeddings = {{1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.7f, 0.7f}};
+    const std::string galleryPath = std::string(directory) + "/gallery.bin";
+    Gallery::build(labels, rowLabels, embeddings, modelHash(enrolled))->save(galleryPath);
+
+    std::shared_ptr<const Gallery> gallery = Gallery::map(galleryPath);
+    check(gallery->size() == 3 && gallery->dimension() == 3, "the saved gallery maps back");
+    check(gallery->enrolledWith(enrolled), "the network the gallery was enrolled with is accepted");
+    check(!gallery->enrolledWith(other), "another network is refused");
+    check(!Gallery::build(labels, rowLabels, embeddings)->enrolledWith(enrolled), "an unstamped gallery is refused");
+
+    // Same path, retrained weights
+    writeModel(directory, "enrolled", "weights of the retrained network");
+    check(!gallery->enrolledWith(enrolled), "another version of the network is refused");
+
+    for (const char *file : {"enrolled.xml", "enrolled.bin", "other.xml", "other.bin", "gallery.bin"}) {
+        unlink((std::string(directory) + "/" + file).c_str());
+    }
+    rmdir(directory);
+    if (failures == 0) {
+        std::cout << "Gallery enrollment OK" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+// Fails when a frame recognized in steady state allocates from the heap: the engine
+// recognizes an image until warmed up, then every stage is checked against a budget of
+// 0 allocations per frame. Requires ENABLE_ALLOCATION_TRACKING.
+//
+//   steady_state_allocations [image] [warm-up frames] [frames]
+
+#include <cstdlib>
+#include <string>
+
+#include <samples/slog.hpp>
+
+#include "allocation_tracker.hpp"
+#include "engine.hpp"
+
+int main(int argc, char *argv[]) {
+    const std::string path = argc > 1 ? argv[1] : "data/together.jpg";
+    const int warmupFrames = argc > 2 ? std::atoi(argv[2]) : 10;
+    const int frames = argc > 3 ? std::atoi(argv[3]) : 50;
+    if (!AllocationTracker::available()) {
+        slog::err << "Allocation tracking is not built in, enable ENABLE_ALLOCATION_TRACKING" << slog::endl;
+        return 1;
+    }
+    try {
+        const cv::Mat image = cv::imread(path);
+        if (image.empty()) {
+            throw std::logic_error("Cannot read " + path);
+        }
+        FaceRecognitionEngine engine;
+        cv::Mat detectedFacesImage;
+        cv::Mat recognizedFacesImage;
+        RecognitionResult recognition;
+
+        for (int i = 0; i < warmupFrames; ++i) {
+            engine.recognize(image, detectedFacesImage, recognizedFacesImage, recognition);
+        }
+        AllocationTracker::start();
+        for (int i = 0; i < frames; ++i) {
+            engine.recognize(image, detectedFacesImage, recognizedFacesImage, recognition);
+        }
+        AllocationTracker::stop();
+        if (AllocationTracker::frames() == 0) {
+            throw std::logic_error("No frame was measured");
+        }
+        return AllocationTracker::checkBudget(0.0) > 0 ? 1 : 0;
+    }
+    catch (const std::exception &error) {
+        AllocationTracker::stop();
+        slog::err << error.what() << slog::endl;
+        return 1;
+    }
+}